@@ -0,0 +1,37 @@
+#include "stdafx.h"
+
+#include "Arena.h"
+
+namespace slic {
+
+void Arena::Reset(const size_t& bytes) {
+    used = 0;
+
+    if (bytes <= capacity)
+        return;
+
+    // the old pieces are all invalid now, so the block is replaced rather than grown
+    storage.reset();
+    storage.reset(new uchar[bytes + alignment - 1]);
+
+    base = storage.get() + (alignment - (size_t)storage.get() % alignment) % alignment;
+    capacity = bytes;
+}
+
+void* Arena::Allocate(const size_t& bytes) {
+    const size_t size = Aligned(bytes);
+
+    // the sizes passed to Reset() cover every allocation of a run
+    CV_Assert(used + size <= capacity);
+
+    void* piece = base + used;
+    used += size;
+
+    return piece;
+}
+
+cv::Mat Arena::AllocateMat(const cv::Size& size, const int& type) {
+    return cv::Mat(size, type, Allocate((size_t)size.width * size.height * CV_ELEM_SIZE(type)));
+}
+
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <memory>
+
+#include <opencv2/core.hpp>
+
+namespace slic {
+
+// One block of working memory handed out in 64-byte aligned pieces, so every buffer starts on
+// its own cache line. Reset() takes the whole block back by rewinding an offset; the heap is
+// only touched when a run needs more than any run before it.
+class Arena {
+public:
+    static const size_t alignment = 64;
+
+    Arena() : base(nullptr), capacity(0), used(0) {}
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    // Starts over with room for 'bytes', the sum of the Aligned() sizes of everything the run
+    // will allocate. Every piece handed out before is invalid afterwards.
+    void Reset(const size_t& bytes);
+
+    void* Allocate(const size_t& bytes);
+
+    template<typename T>
+    T* Allocate(const size_t& count) { return static_cast<T*>(Allocate(count * sizeof(T))); }
+
+    // Header over arena memory; create() on it is a no-op as long as the size and type match.
+    cv::Mat AllocateMat(const cv::Size& size, const int& type);
+
+    static size_t Aligned(const size_t& bytes) { return (bytes + alignment - 1) & ~(alignment - 1); }
+    static size_t MatBytes(const cv::Size& size, const int& type) { return Aligned((size_t)size.width * size.height * CV_ELEM_SIZE(type)); }
+
+    const void* Data() const { return base; }
+    size_t Capacity() const { return capacity; }
+    size_t Used() const { return used; }
+
+private:
+    std::unique_ptr<uchar[]> storage;
+    uchar* base; // first aligned byte of the storage
+    size_t capacity, used;
+};
+
+}
@@ -0,0 +1,439 @@
+#include "stdafx.h"
+
+#include "Segmenter.h"
+
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#include <opencv2/core/utils/filesystem.hpp>
+
+enum class ScheduleMode {
+    Auto,   // small images one per worker, large ones one at a time across all cores
+    Images, // every image on a single worker
+    Pixels  // every image on all cores, one after another
+};
+
+struct BatchOptions {
+    std::vector<std::string> inputs;
+    std::string output = ".";
+    slic::Params params;
+    int workers = 0; // 0 for one per core
+    ScheduleMode mode = ScheduleMode::Auto;
+    double largeMegapixels = 4; // images from this size on are segmented with intra-image parallelism
+    double keptMegapixels = 200; // large images the first pass already decoded are kept for the second up to this total
+    bool writeLabels = true;
+    bool writeRender = true;
+};
+
+// Input image and the path of its results below --output, without the suffixes.
+struct BatchImage {
+    std::string path;
+    std::string name; // relative path of the input without its extension
+};
+
+// Large image left to the second pass, still decoded while the kept total fits the budget.
+struct DeferredImage {
+    int index;
+    cv::Mat img;
+};
+
+// Outcome of one image, printed as a CSV row.
+struct BatchResult {
+    std::string path;
+    int width, height, iterations;
+    double segmentMilliseconds, totalMilliseconds;
+    bool intraImage;
+};
+
+bool ParseOptions(int argc, char** argv, BatchOptions& options);
+
+bool CollectImages(const std::vector<std::string>& inputs, std::vector<BatchImage>& images);
+
+std::string RelativeName(const std::string& path);
+
+bool FindCollisions(const std::vector<BatchImage>& images);
+
+bool ProcessImage(slic::Segmenter& segmenter, const BatchOptions& options, const BatchImage& image, const cv::Mat& img, BatchResult& result);
+
+void ReportImage(const BatchResult& result);
+
+double MillisecondsSince(const std::chrono::high_resolution_clock::time_point& start);
+
+std::mutex reportMutex;
+
+
+int main(int argc, char** argv) {
+    BatchOptions options;
+
+    if (!ParseOptions(argc, argv, options) || options.inputs.empty()) {
+        std::cerr << "Usage: slic_batch [--output DIR] [--superpixels K] [--compactness M | --slico] [--pyramid LEVELS | --snic] [--workers N]\n"
+            << "                  [--mode auto|images|pixels] [--large-megapixels MP] [--kept-megapixels MP] [--no-labels] [--no-render]\n"
+            << "                  DIRECTORY|LIST.txt|IMAGE..." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // 16-bit PNG holds the labels 0 to 65534, 65535 marks pixels without a cluster
+    if (options.writeLabels && options.params.superpixels >= 65535) {
+        std::cerr << "The 16-bit label maps hold at most 65534 superpixels, use --no-labels for more" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::vector<BatchImage> images;
+    std::vector<DeferredImage> deferred;
+    if (!CollectImages(options.inputs, images))
+        return EXIT_FAILURE;
+
+    // results are named after the input paths, two inputs with one name would overwrite each other
+    if (FindCollisions(images))
+        return EXIT_FAILURE;
+
+    const int cores = cv::getNumberOfCPUs();
+    const int workers = options.workers > 0 ? options.workers : cores;
+
+    std::atomic<int> next(0), failed(0);
+    std::atomic<int64> pixels(0);
+    std::mutex deferredMutex;
+    double keptPixels = 0; // pixels of the deferred images that stay decoded
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    std::cout << "path,width,height,iterations,segment_ms,total_ms,intra_image" << std::endl;
+
+    // one image per worker, the engine runs serially inside each of them
+    if (options.mode != ScheduleMode::Pixels) {
+        cv::setNumThreads(1);
+
+        std::vector<std::thread> pool;
+
+        for (int w = 0; w < workers; w++) {
+            pool.emplace_back([&]() {
+                slic::Params params = options.params;
+                params.threads = 1;
+
+                slic::Segmenter segmenter(params);
+                BatchResult result;
+
+                for (int i; (i = next++) < (int)images.size();) {
+                    const auto imageStart = std::chrono::high_resolution_clock::now();
+                    const cv::Mat img = cv::imread(images[i].path, cv::IMREAD_COLOR);
+
+                    // large images wait for the second pass, where all cores work on each of them; the
+                    // decoded pixels go along as long as they fit the budget, the others are decoded again
+                    if (options.mode == ScheduleMode::Auto && img.total() >= options.largeMegapixels * 1e6) {
+                        std::lock_guard<std::mutex> lock(deferredMutex);
+                        const bool keep = keptPixels + img.total() <= options.keptMegapixels * 1e6;
+
+                        keptPixels += keep ? img.total() : 0;
+                        deferred.push_back(DeferredImage{ i, keep ? img : cv::Mat() });
+                        continue;
+                    }
+
+                    if (!ProcessImage(segmenter, options, images[i], img, result)) {
+                        failed++;
+                        continue;
+                    }
+
+                    result.totalMilliseconds = MillisecondsSince(imageStart);
+                    result.intraImage = false;
+                    pixels += img.total();
+                    ReportImage(result);
+                }
+            });
+        }
+
+        for (std::thread& worker : pool)
+            worker.join();
+    }
+    else {
+        for (int i = 0; i < (int)images.size(); i++)
+            deferred.push_back(DeferredImage{ i, cv::Mat() });
+    }
+
+    // the remaining images one after another, each spread over all cores
+    if (!deferred.empty()) {
+        cv::setNumThreads(cores);
+
+        slic::Params params = options.params;
+        params.threads = cores;
+
+        slic::Segmenter segmenter(params);
+        BatchResult result;
+
+        for (DeferredImage& image : deferred) {
+            const auto imageStart = std::chrono::high_resolution_clock::now();
+            const BatchImage& input = images[image.index];
+            const cv::Mat img = image.img.empty() ? cv::imread(input.path, cv::IMREAD_COLOR) : image.img;
+
+            // the kept pixels are released as soon as the image is done
+            image.img.release();
+
+            if (!ProcessImage(segmenter, options, input, img, result)) {
+                failed++;
+                continue;
+            }
+
+            result.totalMilliseconds = MillisecondsSince(imageStart);
+            result.intraImage = true;
+            pixels += img.total();
+            ReportImage(result);
+        }
+    }
+
+    const double elapsed = MillisecondsSince(start) / 1000;
+    const int succeeded = (int)images.size() - failed;
+
+    std::cerr << "Processed " << succeeded << " of " << images.size() << " images in " << elapsed << " s: "
+        << succeeded / elapsed << " images/s, " << pixels / (elapsed * 1e6) << " MP/s" << std::endl;
+
+    return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+bool ParseOptions(int argc, char** argv, BatchOptions& options) {
+
+    for (int i = 1; i < argc; i++) {
+        const std::string option = argv[i];
+
+        if (option.compare(0, 2, "--") != 0) {
+            options.inputs.push_back(option);
+            continue;
+        }
+
+        if (option == "--no-labels") {
+            options.writeLabels = false;
+            continue;
+        }
+
+        if (option == "--no-render") {
+            options.writeRender = false;
+            continue;
+        }
+
+        if (option == "--slico") {
+            options.params.adaptiveCompactness = true;
+            continue;
+        }
+
+        if (option == "--snic") {
+            options.params.engine = slic::Engine::PriorityQueue;
+            continue;
+        }
+
+        if (i + 1 >= argc)
+            return false;
+
+        const std::string value = argv[++i];
+
+        if (option == "--output")
+            options.output = value;
+        else if (option == "--superpixels")
+            options.params.superpixels = std::max(atoi(value.c_str()), 1);
+        else if (option == "--compactness")
+            options.params.compactness = std::max(atoi(value.c_str()), 1);
+        else if (option == "--pyramid")
+            options.params.pyramidLevels = std::max(atoi(value.c_str()), 0);
+        else if (option == "--workers")
+            options.workers = std::max(atoi(value.c_str()), 0);
+        else if (option == "--large-megapixels")
+            options.largeMegapixels = atof(value.c_str());
+        else if (option == "--kept-megapixels")
+            options.keptMegapixels = std::max(atof(value.c_str()), 0.0);
+        else if (option == "--mode" && value == "auto")
+            options.mode = ScheduleMode::Auto;
+        else if (option == "--mode" && value == "images")
+            options.mode = ScheduleMode::Images;
+        else if (option == "--mode" && value == "pixels")
+            options.mode = ScheduleMode::Pixels;
+        else
+            return false;
+    }
+
+    return true;
+}
+
+bool CollectImages(const std::vector<std::string>& inputs, std::vector<BatchImage>& images) {
+    const char* extensions[] = { ".jpg", ".jpeg", ".png", ".bmp", ".tif", ".tiff", ".ppm", ".webp" };
+
+    for (const std::string& input : inputs) {
+        const size_t dot = input.find_last_of('.');
+        std::string extension = dot == std::string::npos ? "" : input.substr(dot);
+        std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+
+        // a text file lists one image per line
+        if (extension == ".txt" || extension == ".lst") {
+            std::ifstream list(input);
+            std::string line;
+
+            if (!list.is_open()) {
+                std::cerr << "Unable to read the list " << input << std::endl;
+                return false;
+            }
+
+            while (std::getline(list, line))
+                if (!line.empty())
+                    images.push_back(BatchImage{ line, RelativeName(line) });
+
+            continue;
+        }
+
+        if (std::find(std::begin(extensions), std::end(extensions), extension) != std::end(extensions)) {
+            images.push_back(BatchImage{ input, RelativeName(input) });
+            continue;
+        }
+
+        // anything else has to be a directory, cv::glob() throws for a path that does not exist
+        if (!cv::utils::fs::isDirectory(input)) {
+            std::cerr << input << " is neither an image, a list nor a directory" << std::endl;
+            return false;
+        }
+
+        std::vector<cv::String> files;
+        cv::glob(input, files, false);
+
+        for (const cv::String& file : files) {
+            const size_t fileDot = file.find_last_of('.');
+            std::string fileExtension = fileDot == cv::String::npos ? "" : std::string(file.substr(fileDot));
+            std::transform(fileExtension.begin(), fileExtension.end(), fileExtension.begin(), ::tolower);
+
+            // the files of a directory are named relative to it
+            const size_t slash = file.find_last_of("/\\");
+            const std::string name = slash == cv::String::npos ? std::string(file) : std::string(file.substr(slash + 1));
+
+            if (std::find(std::begin(extensions), std::end(extensions), fileExtension) != std::end(extensions))
+                images.push_back(BatchImage{ file, RelativeName(name) });
+        }
+    }
+
+    return true;
+}
+
+std::string RelativeName(const std::string& path) {
+    std::string name, part;
+
+    // roots, drive letters and '.' or '..' are dropped, so every result lands below --output
+    for (size_t i = 0; i <= path.size(); i++) {
+        if (i < path.size() && path[i] != '/' && path[i] != '\\') {
+            part += path[i];
+            continue;
+        }
+
+        const bool drive = name.empty() && !part.empty() && part.back() == ':';
+
+        if (!part.empty() && part != "." && part != ".." && !drive)
+            name += (name.empty() ? "" : "/") + part;
+
+        part.clear();
+    }
+
+    const size_t slash = name.find_last_of('/');
+    const size_t dot = name.find_last_of('.');
+
+    return dot == std::string::npos || (slash != std::string::npos && dot < slash) ? name : name.substr(0, dot);
+}
+
+bool FindCollisions(const std::vector<BatchImage>& images) {
+    std::unordered_map<std::string, size_t> owners;
+    bool collided = false;
+
+    for (size_t i = 0; i < images.size(); i++) {
+        std::string key = images[i].name;
+
+        // case-insensitive file systems would merge names that differ in case only
+        std::transform(key.begin(), key.end(), key.begin(), ::tolower);
+
+        const auto owner = owners.emplace(key, i);
+
+        if (!owner.second) {
+            std::cerr << images[i].path << " and " << images[owner.first->second].path << " would both write " << images[i].name << "_*.png" << std::endl;
+            collided = true;
+        }
+    }
+
+    return collided;
+}
+
+bool ProcessImage(slic::Segmenter& segmenter, const BatchOptions& options, const BatchImage& image, const cv::Mat& img, BatchResult& result) {
+    const std::string& path = image.path;
+
+    if (img.empty()) {
+        std::lock_guard<std::mutex> lock(reportMutex);
+        std::cerr << "Unable to read " << path << std::endl;
+        return false;
+    }
+
+    // an exception inside the engine ends this image only, not the worker thread and the batch
+    try {
+        const auto start = std::chrono::high_resolution_clock::now();
+        const cv::Mat& labels = segmenter.Segment(img);
+
+        result.segmentMilliseconds = MillisecondsSince(start);
+        result.path = path;
+        result.width = img.cols;
+        result.height = img.rows;
+        result.iterations = segmenter.Iterations();
+
+        const std::string stem = options.output + "/" + image.name;
+        bool written = true;
+
+        // the relative path of the input is mirrored below the output directory
+        const size_t slash = stem.find_last_of('/');
+        cv::utils::fs::createDirectories(stem.substr(0, slash));
+
+        // labels go out as 16-bit PNG, 0 to 65534 for the clusters and 65535 for pixels without one;
+        // the grid can hold a few more clusters than K, so the count is checked again
+        if (options.writeLabels && segmenter.Centroids().size() >= 65535) {
+            std::lock_guard<std::mutex> lock(reportMutex);
+            std::cerr << path << " has " << segmenter.Centroids().size() << " clusters, more than a 16-bit label map holds" << std::endl;
+            return false;
+        }
+
+        if (options.writeLabels) {
+            cv::Mat labels16(labels.size(), CV_16UC1);
+
+            for (int y = 0; y < labels.rows; y++) {
+                const int* labelRow = labels.ptr<int>(y);
+                ushort* labels16Row = labels16.ptr<ushort>(y);
+
+                for (int x = 0; x < labels.cols; x++)
+                    labels16Row[x] = labelRow[x] >= 0 ? (ushort)labelRow[x] : (ushort)65535;
+            }
+
+            written &= cv::imwrite(stem + "_labels.png", labels16);
+        }
+
+        if (options.writeRender) {
+            cv::Mat render = img.clone();
+            segmenter.Colorate(render);
+            written &= cv::imwrite(stem + "_mean.png", render);
+        }
+
+        if (!written) {
+            std::lock_guard<std::mutex> lock(reportMutex);
+            std::cerr << "Unable to write the results of " << path << std::endl;
+        }
+
+        return written;
+    }
+    catch (const std::exception& e) {
+        std::lock_guard<std::mutex> lock(reportMutex);
+        std::cerr << "Unable to segment " << path << ": " << e.what() << std::endl;
+        return false;
+    }
+}
+
+void ReportImage(const BatchResult& result) {
+    std::lock_guard<std::mutex> lock(reportMutex);
+
+    std::cout << result.path << "," << result.width << "," << result.height << "," << result.iterations << ","
+        << result.segmentMilliseconds << "," << result.totalMilliseconds << "," << (result.intraImage ? 1 : 0) << std::endl;
+}
+
+double MillisecondsSince(const std::chrono::high_resolution_clock::time_point& start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
\ No newline at end of file
@@ -0,0 +1,247 @@
+#include "stdafx.h"
+
+#include "Segmenter.h"
+
+#include <iostream>
+#include <chrono>
+#include <algorithm>
+#include <sstream>
+
+#ifndef SLIC_IMAGE_DIR
+#define SLIC_IMAGE_DIR "images"
+#endif
+
+struct BenchmarkOptions {
+    std::string directory = SLIC_IMAGE_DIR;
+    std::vector<std::string> images = { "bear", "polar", "noise", "gradient" };
+    std::vector<double> megapixels = { 0.3, 1, 4, 12, 50 };
+    std::vector<double> superpixels = { 100, 1000, 5000, 20000 };
+    std::vector<double> threads;
+    std::vector<double> pyramid = { 0 }; // pyramid levels, 0 for the plain full-resolution run
+    std::vector<std::string> engines = { "slic" }; // slic for the iterations, snic for the priority queue
+    int repetitions = 3;
+    int iterations = 10; // fixed number of passes, so every run of a configuration does the same work
+};
+
+// Medians over the repetitions of one configuration, in milliseconds.
+struct BenchmarkResult {
+    slic::StageTimings stages;
+    double render, fastest;
+};
+
+bool ParseOptions(int argc, char** argv, BenchmarkOptions& options);
+
+std::vector<double> ParseList(const std::string& text);
+
+bool LoadImage(const BenchmarkOptions& options, const std::string& name, const double& megapixels, cv::Mat& img);
+
+BenchmarkResult Measure(slic::Segmenter& segmenter, const cv::Mat& img, const int& repetitions);
+
+double Median(std::vector<double> values);
+
+
+int main(int argc, char** argv) {
+    BenchmarkOptions options;
+
+    if (!ParseOptions(argc, argv, options)) {
+        std::cerr << "Usage: slic_benchmark [--images DIR] [--inputs bear,polar,noise,gradient] [--megapixels 0.3,1,4,12,50]\n"
+            << "                      [--superpixels 100,1000,5000,20000] [--threads 1,2,4] [--pyramid 0,2] [--engines slic,snic]\n"
+            << "                      [--repetitions N] [--iterations N]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // powers of two up to the number of cores unless the thread counts are given
+    if (options.threads.empty()) {
+        for (int t = 1; t < cv::getNumberOfCPUs(); t *= 2)
+            options.threads.push_back(t);
+
+        options.threads.push_back(cv::getNumberOfCPUs());
+    }
+
+    // one CSV row per configuration, so runs of different builds can be diffed
+    std::cout << "image,width,height,superpixels,threads,pyramid,engine,iterations,conversion_ms,seeding_ms,assignment_ms,update_ms,connectivity_ms,render_ms,total_ms,min_total_ms,megapixels_per_s" << std::endl;
+
+    cv::Mat img;
+
+    for (const std::string& name : options.images) {
+        for (const double megapixels : options.megapixels) {
+
+            if (!LoadImage(options, name, megapixels, img)) {
+                std::cerr << "Unable to load " << name << std::endl;
+                continue;
+            }
+
+            for (const double K : options.superpixels) {
+                for (const double threads : options.threads) {
+                    for (const double levels : options.pyramid) {
+                        for (const std::string& engine : options.engines) {
+
+                            // the priority queue has no pyramid, one run of it is enough
+                            if (engine == "snic" && levels > 0)
+                                continue;
+
+                            slic::Params params;
+                            params.superpixels = (int)K;
+                            params.threads = (int)threads;
+                            params.maxIterations = options.iterations;
+                            params.pyramidLevels = (int)levels;
+                            params.engine = engine == "snic" ? slic::Engine::PriorityQueue : slic::Engine::Iterative;
+
+                            cv::setNumThreads((int)threads);
+
+                            slic::Segmenter segmenter(params);
+                            const BenchmarkResult result = Measure(segmenter, img, options.repetitions);
+
+                            std::cout << name << "," << img.cols << "," << img.rows << "," << (int)K << "," << (int)threads << "," << (int)levels << "," << engine << "," << segmenter.Iterations() << ","
+                                << result.stages.conversion << "," << result.stages.seeding << "," << result.stages.assignment << "," << result.stages.update << "," << result.stages.connectivity << ","
+                                << result.render << "," << result.stages.total << "," << result.fastest << ","
+                                << img.total() / (result.stages.total * 1000) << std::endl;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+
+bool ParseOptions(int argc, char** argv, BenchmarkOptions& options) {
+
+    for (int i = 1; i < argc; i++) {
+        const std::string option = argv[i];
+
+        if (i + 1 >= argc)
+            return false;
+
+        const std::string value = argv[++i];
+
+        if (option == "--images")
+            options.directory = value;
+        else if (option == "--inputs") {
+            std::stringstream stream(value);
+            std::string name;
+
+            options.images.clear();
+            while (std::getline(stream, name, ','))
+                options.images.push_back(name);
+        }
+        else if (option == "--megapixels")
+            options.megapixels = ParseList(value);
+        else if (option == "--superpixels")
+            options.superpixels = ParseList(value);
+        else if (option == "--threads")
+            options.threads = ParseList(value);
+        else if (option == "--pyramid")
+            options.pyramid = ParseList(value);
+        else if (option == "--engines") {
+            std::stringstream stream(value);
+            std::string engine;
+
+            options.engines.clear();
+            while (std::getline(stream, engine, ','))
+                if (engine == "slic" || engine == "snic")
+                    options.engines.push_back(engine);
+                else return false;
+        }
+        else if (option == "--repetitions")
+            options.repetitions = std::max(atoi(value.c_str()), 1);
+        else if (option == "--iterations")
+            options.iterations = std::max(atoi(value.c_str()), 0);
+        else
+            return false;
+    }
+
+    return true;
+}
+
+std::vector<double> ParseList(const std::string& text) {
+    std::vector<double> values;
+    std::stringstream stream(text);
+    std::string value;
+
+    while (std::getline(stream, value, ','))
+        values.push_back(atof(value.c_str()));
+
+    return values;
+}
+
+bool LoadImage(const BenchmarkOptions& options, const std::string& name, const double& megapixels, cv::Mat& img) {
+    const double pixels = megapixels * 1e6;
+
+    if (name == "noise" || name == "gradient") {
+        const int cols = (int)std::round(std::sqrt(pixels * 4 / 3));
+        const int rows = (int)std::round(pixels / cols);
+
+        img.create(rows, cols, CV_8UC3);
+
+        // uniform noise is the worst case for convergence, a smooth gradient the best
+        if (name == "noise") {
+            cv::randu(img, cv::Scalar::all(0), cv::Scalar::all(256));
+            return true;
+        }
+
+        for (int y = 0; y < rows; y++) {
+            cv::Vec3b* imgRow = img.ptr<cv::Vec3b>(y);
+
+            for (int x = 0; x < cols; x++)
+                imgRow[x] = cv::Vec3b((uchar)(255 * x / cols), (uchar)(255 * y / rows), (uchar)(255 * (x + y) / (cols + rows)));
+        }
+
+        return true;
+    }
+
+    const cv::Mat source = cv::imread(options.directory + "/" + name + ".jpg", cv::IMREAD_COLOR);
+
+    if (source.empty())
+        return false;
+
+    const double scale = std::sqrt(pixels / source.total());
+    cv::resize(source, img, cv::Size(), scale, scale, scale < 1 ? cv::INTER_AREA : cv::INTER_LINEAR);
+    return true;
+}
+
+BenchmarkResult Measure(slic::Segmenter& segmenter, const cv::Mat& img, const int& repetitions) {
+    std::vector<double> conversion, seeding, assignment, update, connectivity, render, total;
+    cv::Mat result;
+
+    // the first call allocates the buffers every later call reuses
+    segmenter.Segment(img);
+
+    for (int i = 0; i < repetitions; i++) {
+        segmenter.Segment(img);
+
+        const slic::StageTimings& timings = segmenter.Timings();
+        conversion.push_back(timings.conversion);
+        seeding.push_back(timings.seeding);
+        assignment.push_back(timings.assignment);
+        update.push_back(timings.update);
+        connectivity.push_back(timings.connectivity);
+        total.push_back(timings.total);
+
+        auto start = std::chrono::high_resolution_clock::now();
+
+        img.copyTo(result);
+        segmenter.Colorate(result);
+
+        auto end = std::chrono::high_resolution_clock::now();
+        render.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+    }
+
+    BenchmarkResult median;
+    median.stages.conversion = Median(conversion);
+    median.stages.seeding = Median(seeding);
+    median.stages.assignment = Median(assignment);
+    median.stages.update = Median(update);
+    median.stages.connectivity = Median(connectivity);
+    median.stages.total = Median(total);
+    median.render = Median(render);
+    median.fastest = *std::min_element(total.begin(), total.end());
+    return median;
+}
+
+double Median(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    return values[values.size() / 2];
+}
\ No newline at end of file
@@ -0,0 +1,335 @@
+#include "stdafx.h"
+
+#include "Mapped.h"
+
+#include <algorithm>
+#include <cctype>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace slic {
+
+bool NextToken(const uchar* data, const size_t& size, size_t& position, std::string& token);
+
+bool ParseNetpbmHeader(const uchar* data, const size_t& size, RawFormat& format);
+
+bool ParseSidecar(const std::string& path, RawFormat& format);
+
+
+#ifdef _WIN32
+
+MappedFile::MappedFile()
+    : data(nullptr), size(0), file(INVALID_HANDLE_VALUE), mapping(nullptr) {}
+
+bool MappedFile::OpenRead(const std::string& path) {
+    Close();
+
+    file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    LARGE_INTEGER length;
+
+    if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &length) || length.QuadPart == 0) {
+        Close();
+        return false;
+    }
+
+    mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    data = mapping ? (uchar*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    size = (size_t)length.QuadPart;
+
+    if (!data)
+        Close();
+
+    return data != nullptr;
+}
+
+bool MappedFile::Create(const std::string& path, const size_t& size) {
+    Close();
+
+    file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+    // the mapping extends the file to its full size
+    if (file != INVALID_HANDLE_VALUE && size > 0) {
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, (DWORD)((uint64)size >> 32), (DWORD)size, nullptr);
+        data = mapping ? (uchar*)MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, 0) : nullptr;
+        this->size = size;
+    }
+
+    if (!data)
+        Close();
+
+    return data != nullptr;
+}
+
+void MappedFile::Close() {
+    if (data)
+        UnmapViewOfFile(data);
+
+    if (mapping)
+        CloseHandle(mapping);
+
+    if (file != INVALID_HANDLE_VALUE)
+        CloseHandle(file);
+
+    data = nullptr;
+    size = 0;
+    file = INVALID_HANDLE_VALUE;
+    mapping = nullptr;
+}
+
+#else
+
+MappedFile::MappedFile()
+    : data(nullptr), size(0), file(-1) {}
+
+bool MappedFile::OpenRead(const std::string& path) {
+    Close();
+
+    file = open(path.c_str(), O_RDONLY);
+    struct stat status;
+
+    if (file < 0 || fstat(file, &status) != 0 || status.st_size == 0) {
+        Close();
+        return false;
+    }
+
+    void* address = mmap(nullptr, (size_t)status.st_size, PROT_READ, MAP_SHARED, file, 0);
+
+    if (address == MAP_FAILED) {
+        Close();
+        return false;
+    }
+
+    data = (uchar*)address;
+    size = (size_t)status.st_size;
+    return true;
+}
+
+bool MappedFile::Create(const std::string& path, const size_t& size) {
+    Close();
+
+    file = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+    // a sparse file of the final size, pages get backing storage as they are written
+    if (file < 0 || size == 0 || ftruncate(file, (off_t)size) != 0) {
+        Close();
+        return false;
+    }
+
+    void* address = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+
+    if (address == MAP_FAILED) {
+        Close();
+        return false;
+    }
+
+    data = (uchar*)address;
+    this->size = size;
+    return true;
+}
+
+void MappedFile::Close() {
+    if (data)
+        munmap(data, size);
+
+    if (file >= 0)
+        close(file);
+
+    data = nullptr;
+    size = 0;
+    file = -1;
+}
+
+#endif
+
+MappedFile::~MappedFile() {
+    Close();
+}
+
+bool MappedImage::Open(const std::string& path) {
+    const size_t dot = path.find_last_of('.');
+    std::string extension = dot == std::string::npos ? "" : path.substr(dot);
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+
+    RawFormat format;
+
+    // the header of a Netpbm file is read from the mapping itself
+    if (extension == ".ppm" || extension == ".pam")
+        return file.OpenRead(path) && ParseNetpbmHeader(file.Data(), file.Size(), format) && Map(format);
+
+    return ParseSidecar(path + ".hdr", format) && file.OpenRead(path) && Map(format);
+}
+
+bool MappedImage::Open(const std::string& path, const RawFormat& format) {
+    return file.OpenRead(path) && Map(format);
+}
+
+bool MappedImage::Map(const RawFormat& format) {
+    const size_t pixels = (size_t)format.size.width * format.size.height;
+
+    if (format.size.width <= 0 || format.size.height <= 0 || format.channels < 3 || format.channels > 4 || file.Size() < format.offset + pixels * format.channels) {
+        file.Close();
+        return false;
+    }
+
+    const bool planar = format.layout == PixelLayout::Planar;
+    const uchar* first = file.Data() + format.offset;
+
+    view.size = format.size;
+    view.rowStep = planar ? format.size.width : (size_t)format.size.width * format.channels;
+    view.pixelStep = planar ? 1 : format.channels;
+
+    // blue is the third channel of an RGB file; planar files store whole planes in that order
+    for (int c = 0; c < 3; c++) {
+        const int stored = format.rgb ? 2 - c : c;
+        view.channels[c] = first + (planar ? stored * pixels : stored);
+    }
+
+    return true;
+}
+
+bool MappedImage::Read(const cv::Rect& rect, ImageView& region) {
+    region = view.Region(rect);
+    return true;
+}
+
+bool MappedLabels::Create(const std::string& path, const cv::Size& size, const int& depth) {
+    CV_Assert(depth == CV_32S || depth == CV_16U);
+
+    if (!file.Create(path, (size_t)size.width * size.height * CV_ELEM_SIZE(depth)))
+        return false;
+
+    labels = cv::Mat(size, CV_MAKETYPE(depth, 1), file.Data());
+    return true;
+}
+
+bool MappedLabels::Write(const cv::Rect& rect, const cv::Mat& tile) {
+    cv::Mat target = labels(rect);
+
+    // the target header already has the size and type, so the copy writes into the mapping
+    if (labels.depth() == CV_32S) {
+        tile.copyTo(target);
+        return true;
+    }
+
+    // uint16 holds the labels 0 to 65534, 65535 marks pixels without a cluster
+    for (int y = 0; y < rect.height; y++) {
+        const int* tileRow = tile.ptr<int>(y);
+        ushort* targetRow = target.ptr<ushort>(y);
+
+        for (int x = 0; x < rect.width; x++) {
+            if (tileRow[x] >= 65535)
+                return false;
+
+            targetRow[x] = tileRow[x] >= 0 ? (ushort)tileRow[x] : (ushort)65535;
+        }
+    }
+
+    return true;
+}
+
+bool NextToken(const uchar* data, const size_t& size, size_t& position, std::string& token) {
+    token.clear();
+
+    while (position < size) {
+        if (data[position] == '#')
+            while (position < size && data[position] != '\n')
+                position++;
+        else if (isspace(data[position]))
+            position++;
+        else break;
+    }
+
+    while (position < size && !isspace(data[position]))
+        token += (char)data[position++];
+
+    return !token.empty();
+}
+
+bool ParseNetpbmHeader(const uchar* data, const size_t& size, RawFormat& format) {
+    size_t position = 0;
+    std::string token;
+
+    if (!NextToken(data, size, position, token) || (token != "P6" && token != "P7"))
+        return false;
+
+    format.rgb = true;
+    format.layout = PixelLayout::Interleaved;
+    int maxValue = 0;
+
+    if (token == "P6") {
+        std::string width, height, maximum;
+
+        if (!NextToken(data, size, position, width) || !NextToken(data, size, position, height) || !NextToken(data, size, position, maximum))
+            return false;
+
+        format.size = cv::Size(atoi(width.c_str()), atoi(height.c_str()));
+        format.channels = 3;
+        maxValue = atoi(maximum.c_str());
+    }
+    else {
+        std::string value;
+
+        while (NextToken(data, size, position, token) && token != "ENDHDR") {
+            if (!NextToken(data, size, position, value))
+                return false;
+
+            if (token == "WIDTH")
+                format.size.width = atoi(value.c_str());
+            else if (token == "HEIGHT")
+                format.size.height = atoi(value.c_str());
+            else if (token == "DEPTH")
+                format.channels = atoi(value.c_str());
+            else if (token == "MAXVAL")
+                maxValue = atoi(value.c_str());
+            else if (token == "TUPLTYPE" && value != "RGB" && value != "RGB_ALPHA")
+                return false;
+        }
+
+        if (token != "ENDHDR")
+            return false;
+    }
+
+    // a single whitespace character separates the header from the samples
+    format.offset = position + 1;
+    return maxValue == 255 && format.size.width > 0 && format.size.height > 0;
+}
+
+bool ParseSidecar(const std::string& path, RawFormat& format) {
+    std::ifstream sidecar(path);
+    std::string key, value;
+
+    if (!sidecar.is_open())
+        return false;
+
+    // one "key value" pair per line: width, height, channels, layout, order, offset
+    while (sidecar >> key >> value) {
+        if (key == "width")
+            format.size.width = atoi(value.c_str());
+        else if (key == "height")
+            format.size.height = atoi(value.c_str());
+        else if (key == "channels")
+            format.channels = atoi(value.c_str());
+        else if (key == "layout")
+            format.layout = value == "planar" ? PixelLayout::Planar : PixelLayout::Interleaved;
+        else if (key == "order")
+            format.rgb = value == "rgb";
+        else if (key == "offset")
+            format.offset = (size_t)atoll(value.c_str());
+        else
+            return false;
+    }
+
+    return format.size.width > 0 && format.size.height > 0;
+}
+
+}
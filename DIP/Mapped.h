@@ -0,0 +1,94 @@
+#pragma once
+
+#include "Tiled.h"
+
+namespace slic {
+
+// Whole file mapped into memory, read-only or read-write. Pages are faulted in on demand and
+// written back by the OS, nothing is read or copied up front.
+class MappedFile {
+public:
+    MappedFile();
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool OpenRead(const std::string& path);
+
+    // Creates or truncates 'path' to 'size' bytes and maps it for writing.
+    bool Create(const std::string& path, const size_t& size);
+
+    void Close();
+
+    bool IsOpen() const { return data != nullptr; }
+    uchar* Data() const { return data; }
+    size_t Size() const { return size; }
+
+private:
+    uchar* data;
+    size_t size;
+
+#ifdef _WIN32
+    void* file;
+    void* mapping;
+#else
+    int file;
+#endif
+};
+
+enum class PixelLayout {
+    Interleaved, // all channels of a pixel next to each other
+    Planar       // one full plane per channel
+};
+
+// Storage of 8-bit pixels in a file, as given by a PPM/PAM header or a sidecar.
+struct RawFormat {
+    cv::Size size;
+    int channels = 3; // 3, or 4 when an alpha channel is stored and skipped
+    PixelLayout layout = PixelLayout::Interleaved;
+    bool rgb = false; // channels in R, G, B order instead of B, G, R
+    size_t offset = 0; // bytes before the first pixel
+};
+
+// Image mapped from a binary PPM (P6), a PAM (P7, RGB or RGB_ALPHA) or a raw file. The
+// segmentation reads the mapping through View(), and tiles through Read(), without any copy.
+class MappedImage : public TileReader {
+public:
+    // Picks the format from the header of a .ppm or .pam file, and from the sidecar
+    // 'path'.hdr for any other file.
+    bool Open(const std::string& path);
+
+    bool Open(const std::string& path, const RawFormat& format);
+
+    const ImageView& View() const { return view; }
+    cv::Size Size() const override { return view.size; }
+    bool Read(const cv::Rect& rect, ImageView& region) override;
+
+private:
+    bool Map(const RawFormat& format);
+
+    MappedFile file;
+    ImageView view;
+};
+
+// Label map written straight into a mapped file as headerless little-endian int32 or uint16
+// rows. The file is created at its final size, so tiles and whole images only fill pages.
+class MappedLabels : public TileWriter {
+public:
+    // 'depth' is CV_32S or CV_16U.
+    bool Create(const std::string& path, const cv::Size& size, const int& depth = CV_32S);
+
+    // Header over the mapping; uint16 stores unlabeled pixels as 65535.
+    const cv::Mat& Labels() const { return labels; }
+
+    // Fails for a label of 65535 or more in a uint16 map, which could not be told apart.
+    bool Write(const cv::Rect& rect, const cv::Mat& tile) override;
+    bool Write(const cv::Mat& labels) { return Write(cv::Rect(cv::Point(), labels.size()), labels); }
+
+private:
+    MappedFile file;
+    cv::Mat labels;
+};
+
+}
@@ -0,0 +1,1834 @@
+#include "stdafx.h"
+
+#include "Segmenter.h"
+
+#include <iostream>
+#include <algorithm>
+#include <sstream>
+#include <chrono>
+#include <limits>
+#include <cstring>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include <opencv2/core/cv_cpu_helper.h> // intrin.hpp relies on the dispatch helpers outside of OpenCV's own build
+#include <opencv2/core/hal/intrin.hpp>
+
+// SLIC_DISABLE_SIMD keeps only the scalar loops, which the tests hold the vector kernels against
+#if CV_SIMD && !defined(SLIC_DISABLE_SIMD)
+#define SLIC_SIMD 1
+#else
+#define SLIC_SIMD 0
+#endif
+
+namespace slic {
+
+// Lookup tables shared by every Lab conversion: the sRGB gamma expansion of each 8-bit value
+// and the CIELAB companding function f(t) sampled over [0, 1].
+struct LabTables {
+    static const int compandingSize = 1024;
+
+    float gamma[256];
+    float companding[compandingSize + 2];
+
+    LabTables() {
+        for (int i = 0; i < 256; i++) {
+            const double v = i / 255.0;
+            gamma[i] = (float)(v <= 0.04045 ? v / 12.92 : std::pow((v + 0.055) / 1.055, 2.4));
+        }
+
+        for (int i = 0; i < compandingSize + 2; i++) {
+            const double t = i / (double)compandingSize;
+            companding[i] = (float)(t > 0.008856 ? std::cbrt(t) : 7.787 * t + 16.0 / 116.0);
+        }
+    }
+
+    float Compand(float t) const {
+        t = std::min(std::max(t, 0.f), 1.f) * compandingSize;
+
+        const int i = (int)t;
+        return companding[i] + (companding[i + 1] - companding[i]) * (t - i);
+    }
+};
+
+// Writable counterpart of an ImageView, so the same loops fill interleaved pixels or the planes
+// of the working image.
+struct ImageTarget {
+    uchar* channels[3];
+    size_t rowStep;
+    int pixelStep;
+
+    explicit ImageTarget(cv::Mat& bgr) : rowStep(bgr.step[0]), pixelStep(3) {
+        for (int c = 0; c < 3; c++)
+            channels[c] = bgr.data + c;
+    }
+
+    explicit ImageTarget(PlanarImage& img) : rowStep(img.planes[0].step[0]), pixelStep(1) {
+        for (int c = 0; c < 3; c++)
+            channels[c] = img.planes[c].data;
+    }
+};
+
+// Converts a band of BGR rows to 8-bit CIELAB.
+class LabConversionBody : public cv::ParallelLoopBody {
+public:
+    LabConversionBody(const ImageView& view, const ImageTarget& target, const LabTables& tables)
+        : view(view), target(target), tables(tables) {}
+
+    void operator()(const cv::Range& range) const override;
+
+private:
+    const ImageView& view;
+    const ImageTarget& target;
+    const LabTables& tables;
+};
+
+// Assigns the pixels of a band of rows. Every band owns its rows exclusively, so the windows
+// of neighbouring centroids can overlap across bands without two threads writing the same pixel.
+class AssignmentBody : public cv::ParallelLoopBody {
+public:
+    AssignmentBody(const PlanarImage& img, cv::Mat& labels, cv::Mat& distances, const int& S, const DistanceMetric& metric, const ActiveSet& activeSet, const CentroidGrid& grid, const AdaptiveCompactness* adaptive)
+        : img(img), labels(labels), distances(distances), S(S), metric(metric), activeSet(activeSet), grid(grid), adaptive(adaptive) {}
+
+    void operator()(const cv::Range& range) const override;
+
+private:
+    const PlanarImage& img;
+    cv::Mat& labels;
+    cv::Mat& distances;
+    const int S;
+    const DistanceMetric metric;
+    const ActiveSet& activeSet;
+    const CentroidGrid& grid;
+    const AdaptiveCompactness* adaptive;
+};
+
+// Finds, for a stripe of rows, the largest squared color and spatial distance between each
+// cluster and the pixels assigned to it.
+class MaximaBody : public cv::ParallelLoopBody {
+public:
+    MaximaBody(const PlanarImage& img, const cv::Mat& labels, const std::vector<ColoredPoint>& centroids, std::vector<float>& stripeMaxima, const int& stripes)
+        : img(img), labels(labels), centroids(centroids), stripeMaxima(stripeMaxima), stripes(stripes) {}
+
+    void operator()(const cv::Range& range) const override;
+
+private:
+    const PlanarImage& img;
+    const cv::Mat& labels;
+    const std::vector<ColoredPoint>& centroids;
+    std::vector<float>& stripeMaxima;
+    const int stripes;
+};
+
+// Sums the pixels of a stripe of rows into the private accumulators of that stripe.
+class AccumulationBody : public cv::ParallelLoopBody {
+public:
+    AccumulationBody(const PlanarImage& img, const cv::Mat& labels, ClusterAccumulator* accumulators, const int& clusters, const int& stripes)
+        : img(img), labels(labels), accumulators(accumulators), clusters(clusters), stripes(stripes) {}
+
+    void operator()(const cv::Range& range) const override;
+
+private:
+    const PlanarImage& img;
+    const cv::Mat& labels;
+    ClusterAccumulator* accumulators;
+    const int clusters, stripes;
+};
+
+// Collects, for a stripe of rows, the pixels whose label differs from the previous pass as
+// removals from the old cluster and additions to the new one, then records the new labels.
+// Only the cells the last pass could relabel are compared, all of them after a full pass.
+class LabelChangeBody : public cv::ParallelLoopBody {
+public:
+    LabelChangeBody(const PlanarImage& img, const cv::Mat& labels, cv::Mat& previousLabels, const ActiveSet& activeSet, ClusterAccumulator* accumulators, const int& clusters, const int& stripes)
+        : img(img), labels(labels), previousLabels(previousLabels), activeSet(activeSet), accumulators(accumulators), clusters(clusters), stripes(stripes) {}
+
+    void operator()(const cv::Range& range) const override;
+
+private:
+    const PlanarImage& img;
+    const cv::Mat& labels;
+    cv::Mat& previousLabels;
+    const ActiveSet& activeSet;
+    ClusterAccumulator* accumulators;
+    const int clusters, stripes;
+};
+
+// Averages the blocks of scale x scale input pixels behind a stripe of rows of the downsampled
+// image; the blocks along the right and bottom edge may be cut off by the border. Every stripe
+// sums a row into its own slice of 'sums'.
+class DownsampleBody : public cv::ParallelLoopBody {
+public:
+    DownsampleBody(const ImageView& view, const int& scale, cv::Mat& small, int* sums, const int& stripes)
+        : view(view), scale(scale), small(small), sums(sums), stripes(stripes) {}
+
+    void operator()(const cv::Range& range) const override;
+
+private:
+    const ImageView& view;
+    const int scale;
+    cv::Mat& small;
+    int* sums;
+    const int stripes;
+};
+
+// Computes the gradient magnitude of a band of rows, with the rows and columns outside the
+// image replicated from the border.
+class GradientBody : public cv::ParallelLoopBody {
+public:
+    GradientBody(const PlanarImage& img, cv::Mat& gradients)
+        : img(img), gradients(gradients) {}
+
+    void operator()(const cv::Range& range) const override;
+
+private:
+    const PlanarImage& img;
+    cv::Mat& gradients;
+};
+
+
+void ConvertToLab(const ImageView& view, const ImageTarget& target);
+
+void CopyChannels(const ImageView& view, const ImageTarget& target);
+
+void DownsampleArea(const ImageView& view, const int& scale, cv::Mat& small, int* sums, const int& stripes);
+
+void DownsampleArea(const ImageView& view, const int& scale, cv::Mat& small, int* sums, const int& stripes) {
+    small.create((view.size.height + scale - 1) / scale, (view.size.width + scale - 1) / scale, CV_8UC3);
+    cv::parallel_for_(cv::Range(0, stripes), DownsampleBody(view, scale, small, sums, stripes), stripes);
+}
+
+void DownsampleBody::operator()(const cv::Range& range) const {
+    const size_t columns = (size_t)small.cols * 3;
+
+    for (int stripe = range.start; stripe < range.end; stripe++) {
+        int* stripeSums = sums + stripe * columns;
+
+        const int fromRow = small.rows * stripe / stripes;
+        const int toRow = small.rows * (stripe + 1) / stripes;
+
+        for (int y = fromRow; y < toRow; y++) {
+            const int fromY = y * scale;
+            const int toY = std::min(fromY + scale, view.size.height);
+
+            std::fill(stripeSums, stripeSums + columns, 0);
+
+            // the input rows of the block are read in order, whatever the layout of the view
+            for (int sy = fromY; sy < toY; sy++) {
+                for (int c = 0; c < 3; c++) {
+                    const uchar* row = view.channels[c] + sy * view.rowStep;
+
+                    for (int sx = 0; sx < view.size.width; sx++)
+                        stripeSums[(sx / scale) * 3 + c] += row[(size_t)sx * view.pixelStep];
+                }
+            }
+
+            cv::Vec3b* smallRow = small.ptr<cv::Vec3b>(y);
+
+            for (int x = 0; x < small.cols; x++) {
+                const int area = (std::min((x + 1) * scale, view.size.width) - x * scale) * (toY - fromY);
+
+                for (int c = 0; c < 3; c++)
+                    smallRow[x][c] = (uchar)((stripeSums[x * 3 + c] + area / 2) / area);
+            }
+        }
+    }
+}
+
+float PixelGradient(const cv::Vec3b& left, const cv::Vec3b& right, const cv::Vec3b& up, const cv::Vec3b& down);
+
+void ComputeGradients(const PlanarImage& img, cv::Mat& gradients);
+
+void ChooseInitialCentroids(const PlanarImage& img, const cv::Mat& gradients, std::vector<ColoredPoint>& centers, const int& S);
+
+ColoredPoint PerturbSeed(const PlanarImage& img, const cv::Mat& gradients, const int& x, const int& y);
+
+DistanceMetric MakeDistanceMetric(const int& S, const int& m, const DistanceMode& mode);
+
+void AssignSpan(const uchar* const channelRows[3], float* distanceRow, int* labelRow, const int& fromX, const int& toX, const int& y, const CentroidGrid& grid, const int& member, const float& colorWeight, const float& spatialWeight);
+
+void AssignSpanFixed(const uchar* const channelRows[3], int* distanceRow, int* labelRow, const int& fromX, const int& toX, const int& y, const CentroidGrid& grid, const int& member, const DistanceMetric& metric);
+
+void AssignToNearestCentroids(const PlanarImage& img, const std::vector<ColoredPoint>& centroids, cv::Mat& labels, cv::Mat& distances, const int& S, const DistanceMetric& metric, const ActiveSet& activeSet, CentroidGrid& grid, const AdaptiveCompactness* adaptive, const int& threads);
+
+void BuildCentroidGrid(CentroidGrid& grid, const std::vector<ColoredPoint>& centroids, const cv::Size& size, const int& S);
+
+void InitActiveSet(ActiveSet& set, const cv::Size& size, const int& count, const int& S);
+
+int UpdateActiveSet(ActiveSet& set, const std::vector<ColoredPoint>& previous, const std::vector<ColoredPoint>& current, const int& S, const int& tolerance, const std::vector<uchar>* reweighted);
+
+void InitAdaptiveCompactness(AdaptiveCompactness& adaptive, const int& count, const int& S);
+
+void UpdateAdaptiveCompactness(const PlanarImage& img, const cv::Mat& labels, const std::vector<ColoredPoint>& centroids, AdaptiveCompactness& adaptive, const int& threads);
+
+void UpdateAccumulators(const PlanarImage& img, const cv::Mat& labels, cv::Mat& previousLabels, const ActiveSet& activeSet, ClusterAccumulator* accumulators, const int& count, const UpdateMode& mode, const bool& restart, const int& threads);
+
+void RecalculateCentroids(std::vector<ColoredPoint>& tempCentroids, const std::vector<ColoredPoint>& centroids, const ClusterAccumulator* accumulators);
+
+int64 GrowSuperpixels(const PlanarImage& img, std::vector<ColoredPoint>& centroids, const std::vector<SeedState>* states, cv::Mat& labels, cv::Mat& queued, const float& spatialWeight, PixelQueue& queue, std::vector<GrowingCluster>& clusters);
+
+int BitLength(const uint32_t& value);
+
+uint32_t DistanceKey(const float& distance);
+
+int EnforceConnectivity(const cv::Mat& labels, cv::Mat& connected, int* segment, const int& minSize);
+
+template<typename T>
+bool VectorsEqual(std::vector<T>& v1, std::vector<T>& v2);
+
+bool VectorsSimilar(const std::vector<ColoredPoint>& v1, const std::vector<ColoredPoint>& v2, const int threshold, const bool& verbose);
+
+int CentroidResidual(const std::vector<ColoredPoint>& v1, const std::vector<ColoredPoint>& v2);
+
+void WriteIterations(std::ostringstream& json, const std::vector<IterationStats>& iterations);
+
+double Lap(std::chrono::high_resolution_clock::time_point& start);
+
+
+Segmenter::Segmenter(const Params& params)
+    : params(params), accumulators(nullptr), segment(nullptr), iterations(0), timings(), downsampleSums(nullptr) {}
+
+const cv::Mat& Segmenter::Segment(const cv::Mat& bgr, Stats* stats) {
+    return Segment(ImageView(bgr), stats);
+}
+
+const cv::Mat& Segmenter::Segment(const ImageView& view, Stats* stats) {
+    CV_Assert(params.superpixels > 0 && view.size.width > 0 && view.size.height > 0);
+
+    const int S = GridInterval(view.size, params.superpixels);
+
+    // every level halves the grid interval, which has to stay wide enough to hold a cluster
+    int levels = params.engine == Engine::Iterative ? params.pyramidLevels : 0;
+    while (levels > 0 && (S >> levels) < 4)
+        levels--;
+
+    if (levels > 0)
+        return RunPyramid(view, S, levels, stats);
+
+    return Run(view, S, nullptr, nullptr, params.maxIterations, stats);
+}
+
+const cv::Mat& Segmenter::Segment(const cv::Mat& bgr, const int& S, std::vector<ColoredPoint>& seeds, const std::vector<SeedState>& states, Stats* stats) {
+    return Segment(ImageView(bgr), S, seeds, states, stats);
+}
+
+const cv::Mat& Segmenter::Segment(const ImageView& view, const int& S, std::vector<ColoredPoint>& seeds, const std::vector<SeedState>& states, Stats* stats) {
+    CV_Assert(view.size.width > 0 && view.size.height > 0 && S > 0 && seeds.size() == states.size());
+
+    Run(view, S, &seeds, &states, params.maxIterations, stats);
+    seeds = centroids;
+
+    return labels;
+}
+
+const cv::Mat& Segmenter::Run(const ImageView& view, const int& S, const std::vector<ColoredPoint>* seeds, const std::vector<SeedState>* states, const int& maxIterations, Stats* stats) {
+    const int superpixelArea = S * S;
+    const int threads = params.threads > 0 ? params.threads : cv::getNumThreads();
+
+    std::vector<std::pair<const void*, size_t>> buffersBefore, buffersAfter;
+
+    if (stats) {
+        *stats = Stats();
+        SnapshotBuffers(buffersBefore);
+    }
+
+    timings = StageTimings();
+
+    auto lap = std::chrono::high_resolution_clock::now();
+
+    PlaceBuffers(view.size, S, seeds ? (int)seeds->size() : GridSeedCount(view.size, S), threads);
+
+    // the conversion writes straight into the planes of the arena
+    if (params.useLab)
+        ConvertToLab(view, ImageTarget(img));
+    else
+        CopyChannels(view, ImageTarget(img));
+
+    timings.conversion = Lap(lap);
+
+    centroids.clear();
+
+    // the gradients only place seeds on the grid, warm-started seeds keep their position
+    if (!seeds || std::find(states->begin(), states->end(), SeedState::Unseeded) != states->end())
+        ComputeGradients(img, gradients);
+
+    if (seeds) {
+        centroids.assign(seeds->begin(), seeds->end());
+
+        for (size_t k = 0; k < centroids.size(); k++)
+            if ((*states)[k] == SeedState::Unseeded)
+                centroids[k] = PerturbSeed(img, gradients, centroids[k].x, centroids[k].y);
+    }
+    else ChooseInitialCentroids(img, gradients, centroids, S);
+
+    // per-cluster storage is sized once, iterations only overwrite it
+    if (params.engine == Engine::Iterative) {
+        tempCentroids.reserve(centroids.size());
+        InitActiveSet(activeSet, img.Size(), (int)centroids.size(), S);
+
+        if (params.adaptiveCompactness)
+            InitAdaptiveCompactness(adaptive, (int)centroids.size(), S);
+    }
+
+    timings.seeding = Lap(lap);
+
+    if (params.engine == Engine::PriorityQueue)
+        Grow(states, S, lap, stats);
+    else Iterate(S, states, maxIterations, threads, lap, stats);
+
+    int merged = 0;
+
+    // grown superpixels are connected by construction
+    if (params.enforceConnectivity && params.engine == Engine::Iterative) {
+        merged = EnforceConnectivity(labels, connectedLabels, segment, (int)(superpixelArea * params.minFragmentSize));
+        std::swap(labels, connectedLabels);
+    }
+
+    timings.connectivity = Lap(lap);
+
+    // the laps leave out the gaps in which the stats are gathered, and so does the total
+    timings.total = timings.conversion + timings.seeding + timings.assignment + timings.update + timings.connectivity;
+
+    if (stats) {
+        SnapshotBuffers(buffersAfter);
+
+        // the centroid vectors swap their storage, so a buffer only counts when its block is new
+        for (const auto& buffer : buffersAfter) {
+            if (buffer.second > 0 && std::find(buffersBefore.begin(), buffersBefore.end(), buffer) == buffersBefore.end()) {
+                stats->allocations++;
+                stats->allocatedBytes += buffer.second;
+            }
+        }
+
+        stats->width = view.size.width;
+        stats->height = view.size.height;
+        stats->clusters = (int)centroids.size();
+        stats->stages = timings;
+        stats->mergedFragments = merged;
+    }
+
+    return labels;
+}
+
+const cv::Mat& Segmenter::RunPyramid(const ImageView& view, const int& S, const int& levels, Stats* stats) {
+    const int scale = 1 << levels;
+    const int threads = params.threads > 0 ? params.threads : cv::getNumThreads();
+
+    auto lap = std::chrono::high_resolution_clock::now();
+
+    // the pyramid level is segmented like any other image, its labels are never needed
+    Params coarseParams = params;
+    coarseParams.pyramidLevels = 0;
+    coarseParams.enforceConnectivity = false;
+
+    if (!coarse)
+        coarse.reset(new Segmenter(coarseParams));
+    else coarse->SetParams(coarseParams);
+
+    // the full-resolution grid scaled down, so both levels have the same clusters
+    const int start = S / 2;
+    pyramidSeeds.clear();
+
+    for (int y = start; y < view.size.height; y += S)
+        for (int x = start; x < view.size.width; x += S)
+            pyramidSeeds.emplace_back(cv::Vec3b(0, 0, 0), x / scale, y / scale);
+
+    pyramidStates.assign(pyramidSeeds.size(), SeedState::Unseeded);
+
+    // the buffers of the full-resolution run are placed early for the downsampling sums; Run()
+    // places the same layout again without touching the heap
+    const std::pair<const void*, size_t> block(arena.Data(), arena.Capacity());
+    PlaceBuffers(view.size, S, (int)pyramidSeeds.size(), threads);
+    const bool grown = block != std::make_pair(arena.Data(), arena.Capacity());
+
+    DownsampleArea(view, scale, coarseImg, downsampleSums, threads);
+
+    Stats coarseStats;
+    auto coarseLap = std::chrono::high_resolution_clock::now();
+    coarse->Segment(coarseImg, std::max(S / scale, 1), pyramidSeeds, pyramidStates, stats ? &coarseStats : nullptr);
+
+    // the stats the coarse level gathers take the wall time its own stages leave out
+    const double coarseInstrumentation = Lap(coarseLap) - coarse->Timings().total;
+
+    // a coarse pixel covers a block of the input, its centroid lands on the middle of that block
+    for (ColoredPoint& seed : pyramidSeeds) {
+        seed.x = std::min(seed.x * scale + scale / 2, view.size.width - 1);
+        seed.y = std::min(seed.y * scale + scale / 2, view.size.height - 1);
+    }
+
+    pyramidStates.assign(pyramidSeeds.size(), SeedState::Free);
+
+    const double pyramid = Lap(lap) - coarseInstrumentation;
+
+    // Run() reads 0 as no limit, but no refinement means only assigning the pixels to the scaled seeds
+    Run(view, S, &pyramidSeeds, &pyramidStates, std::max(params.refinementIterations, 1), stats);
+
+    // the pyramid level is the seeding of the full resolution
+    timings.seeding += pyramid;
+    timings.total += pyramid;
+
+    if (stats) {
+        stats->stages = timings;
+        stats->coarseIterations = coarseStats.iterations;
+
+        // Run() only saw the arena after it had grown
+        if (grown) {
+            stats->allocations++;
+            stats->allocatedBytes += arena.Capacity();
+        }
+    }
+
+    return labels;
+}
+
+void Segmenter::Iterate(const int& S, const std::vector<SeedState>* states, const int& maxIterations, const int& threads, std::chrono::high_resolution_clock::time_point& lap, Stats* stats) {
+    const bool slico = params.adaptiveCompactness;
+
+    // the per-cluster weights are floats, so SLICO always takes the float path
+    const DistanceMetric metric = MakeDistanceMetric(S, params.compactness, slico ? DistanceMode::Float : params.distanceMode);
+    AdaptiveCompactness* weights = slico ? &adaptive : nullptr;
+
+    IterationStats iteration = IterationStats();
+
+    AssignToNearestCentroids(img, centroids, labels, distances, S, metric, activeSet, grid, weights, threads);
+    iterations = 1;
+
+    iteration.milliseconds = Lap(lap);
+    timings.assignment += iteration.milliseconds;
+
+    // the counters are gathered between the laps, so they do not show up in the stage timings
+    if (stats) {
+        reportedLabels.release();
+        RecordAssignment(iteration, S);
+        lap = std::chrono::high_resolution_clock::now();
+    }
+
+    bool restart = true;
+
+    while (true) {
+
+        UpdateAccumulators(img, labels, previousLabels, activeSet, accumulators, (int)centroids.size(), params.updateMode, restart, threads);
+        RecalculateCentroids(tempCentroids, centroids, accumulators);
+        restart = false;
+
+        // fixed seeds were settled elsewhere and only compete for pixels
+        if (states)
+            for (size_t k = 0; k < centroids.size(); k++)
+                if ((*states)[k] == SeedState::Fixed)
+                    tempCentroids[k] = centroids[k];
+
+        // the maxima are taken against the centroids the pixels were just assigned to
+        if (slico)
+            UpdateAdaptiveCompactness(img, labels, centroids, adaptive, threads);
+
+        bool converged = VectorsSimilar(tempCentroids, centroids, params.threshold, params.verbose);
+
+        if (params.freezeClusters)
+            converged |= UpdateActiveSet(activeSet, centroids, tempCentroids, S, params.freezeTolerance, slico ? &adaptive.changed : nullptr) <= params.minActiveFraction * centroids.size();
+
+        converged |= maxIterations > 0 && iterations >= maxIterations;
+
+        const double update = Lap(lap);
+        timings.update += update;
+
+        if (stats) {
+            iteration.milliseconds += update;
+            iteration.residual = CentroidResidual(tempCentroids, centroids);
+            stats->iterations.push_back(iteration);
+            lap = std::chrono::high_resolution_clock::now();
+        }
+
+        if (!converged)
+            centroids.swap(tempCentroids);
+        else break;
+
+        AssignToNearestCentroids(img, centroids, labels, distances, S, metric, activeSet, grid, weights, threads);
+        iterations++;
+
+        iteration.milliseconds = Lap(lap);
+        timings.assignment += iteration.milliseconds;
+
+        if (stats) {
+            RecordAssignment(iteration, S);
+            lap = std::chrono::high_resolution_clock::now();
+        }
+    }
+}
+
+void Segmenter::Grow(const std::vector<SeedState>* states, const int& S, std::chrono::high_resolution_clock::time_point& lap, Stats* stats) {
+    const DistanceMetric metric = MakeDistanceMetric(S, params.compactness, DistanceMode::Float);
+
+    // the distances hold the nearest a pixel has been queued at
+    distances.create(img.Size(), CV_32FC1);
+
+    IterationStats iteration = IterationStats();
+    iteration.distanceEvaluations = GrowSuperpixels(img, centroids, states, labels, distances, metric.spatial, queue, growing);
+    iterations = 1;
+
+    iteration.milliseconds = Lap(lap);
+    timings.assignment = iteration.milliseconds;
+
+    // the single pass labels every pixel once and has no centroids to compare against
+    if (stats) {
+        iteration.changedLabels = (int64)labels.total();
+        iteration.activeClusters = (int)centroids.size();
+        stats->iterations.push_back(iteration);
+        lap = std::chrono::high_resolution_clock::now();
+    }
+}
+
+void Segmenter::RecordAssignment(IterationStats& iteration, const int& S) {
+    const int count = (int)centroids.size();
+    const int threshold = 2 * S;
+
+    iteration.activeClusters = 0;
+    iteration.distanceEvaluations = 0;
+
+    for (int k = 0; k < count; k++) {
+        if (!activeSet.active[k])
+            continue;
+
+        const int width = std::min(centroids[k].x + threshold, img.Cols() - 1) - std::max(centroids[k].x - threshold, 0) + 1;
+        const int height = std::min(centroids[k].y + threshold, img.Rows() - 1) - std::max(centroids[k].y - threshold, 0) + 1;
+
+        iteration.activeClusters++;
+        iteration.distanceEvaluations += (int64)width * height;
+    }
+
+    // the first pass changes every pixel from unlabeled
+    if (reportedLabels.empty()) {
+        iteration.changedLabels = (int64)labels.total();
+        labels.copyTo(reportedLabels);
+        return;
+    }
+
+    iteration.changedLabels = 0;
+
+    for (int y = 0; y < labels.rows; y++) {
+        const int* labelRow = labels.ptr<int>(y);
+        int* reportedRow = reportedLabels.ptr<int>(y);
+
+        for (int x = 0; x < labels.cols; x++) {
+            if (labelRow[x] != reportedRow[x]) {
+                iteration.changedLabels++;
+                reportedRow[x] = labelRow[x];
+            }
+        }
+    }
+}
+
+void Segmenter::PlaceBuffers(const cv::Size& size, const int& S, const int& count, const int& threads) {
+
+    // SLICO and the grown superpixels always measure in floats, and so does a grid too coarse for the fixed-point weight
+    const bool fixed = params.engine == Engine::Iterative && !params.adaptiveCompactness
+        && MakeDistanceMetric(S, params.compactness, params.distanceMode).mode == DistanceMode::Fixed;
+    const int distanceType = fixed ? CV_32SC1 : CV_32FC1;
+    const cv::Size cells((size.width + S - 1) / S, (size.height + S - 1) / S); // as in InitActiveSet()
+    const size_t sums = (size_t)count * (threads + 1);
+    // a fragment of label k lies within the 2S window k was last assigned from; only a freeze
+    // tolerance lets a cluster drift away from the pixels it keeps, and then any size is possible
+    const bool bounded = !params.freezeClusters || params.freezeTolerance == 0;
+    const size_t window = (size_t)(4 * S + 1) * (4 * S + 1);
+    const size_t pixels = (size_t)size.width * size.height;
+    const size_t stack = params.engine == Engine::Iterative && params.enforceConnectivity ? (bounded ? std::min(window, pixels) : pixels) : 0;
+
+    // the flood fill indexes the rows of a fragment below its first one
+    CV_Assert(stack == 0 || (int64)(bounded ? std::min(4 * S + 1, size.height) : size.height) * size.width <= INT_MAX);
+    const size_t rowSums = params.engine == Engine::Iterative && params.pyramidLevels > 0 ? (size_t)threads * ((size.width + 1) / 2) * 3 : 0; // one row per stripe at the finest level
+
+    arena.Reset(3 * Arena::MatBytes(size, CV_8UC1) + Arena::MatBytes(size, CV_32FC1) + 3 * Arena::MatBytes(size, CV_32SC1)
+        + Arena::MatBytes(size, distanceType) + 2 * Arena::MatBytes(cells, CV_8UC1) + Arena::Aligned(sums * sizeof(ClusterAccumulator))
+        + Arena::Aligned(stack * sizeof(int)) + Arena::Aligned(rowSums * sizeof(int)));
+
+    // every plane starts on a cache line of its own
+    for (cv::Mat& plane : img.planes)
+        plane = arena.AllocateMat(size, CV_8UC1);
+
+    gradients = arena.AllocateMat(size, CV_32FC1);
+    labels = arena.AllocateMat(size, CV_32SC1);
+    previousLabels = arena.AllocateMat(size, CV_32SC1);
+    connectedLabels = arena.AllocateMat(size, CV_32SC1);
+    distances = arena.AllocateMat(size, distanceType);
+    activeSet.dirty = arena.AllocateMat(cells, CV_8UC1);
+    activeSet.relabeled = arena.AllocateMat(cells, CV_8UC1);
+    accumulators = arena.Allocate<ClusterAccumulator>(sums);
+    segment = stack > 0 ? arena.Allocate<int>(stack) : nullptr;
+    downsampleSums = rowSums > 0 ? arena.Allocate<int>(rowSums) : nullptr;
+}
+
+void Segmenter::SnapshotBuffers(std::vector<std::pair<const void*, size_t>>& buffers) const {
+
+    // the Mats only count through the arena, which is one block whatever their sizes
+    buffers.emplace_back(arena.Data(), arena.Capacity());
+
+    buffers.emplace_back(centroids.data(), centroids.capacity() * sizeof(ColoredPoint));
+    buffers.emplace_back(tempCentroids.data(), tempCentroids.capacity() * sizeof(ColoredPoint));
+    buffers.emplace_back(activeSet.moved.data(), activeSet.moved.capacity());
+    buffers.emplace_back(activeSet.active.data(), activeSet.active.capacity());
+    buffers.emplace_back(grid.cellStart.data(), grid.cellStart.capacity() * sizeof(int));
+    buffers.emplace_back(grid.members.data(), grid.members.capacity() * sizeof(int));
+
+    const std::vector<int>* members[] = { &grid.cx, &grid.cy, &grid.c0, &grid.c1, &grid.c2 };
+
+    for (const std::vector<int>* member : members)
+        buffers.emplace_back(member->data(), member->capacity() * sizeof(int));
+
+    const std::vector<float>* weights[] = { &adaptive.maxColor, &adaptive.maxSpatial, &adaptive.colorWeights, &adaptive.spatialWeights, &adaptive.stripeMaxima };
+
+    for (const std::vector<float>* weight : weights)
+        buffers.emplace_back(weight->data(), weight->capacity() * sizeof(float));
+
+    buffers.emplace_back(adaptive.changed.data(), adaptive.changed.capacity());
+    queue.SnapshotBuffers(buffers);
+    buffers.emplace_back(growing.data(), growing.capacity() * sizeof(GrowingCluster));
+}
+
+std::string Stats::ToJson() const {
+    std::ostringstream json;
+
+    json << "{\"width\":" << width << ",\"height\":" << height << ",\"clusters\":" << clusters
+        << ",\"stages\":{\"conversion_ms\":" << stages.conversion << ",\"seeding_ms\":" << stages.seeding
+        << ",\"assignment_ms\":" << stages.assignment << ",\"update_ms\":" << stages.update << ",\"connectivity_ms\":" << stages.connectivity << ",\"total_ms\":" << stages.total << "}"
+        << ",\"allocations\":" << allocations << ",\"allocated_bytes\":" << allocatedBytes << ",\"merged_fragments\":" << mergedFragments
+        << ",\"iterations\":";
+
+    WriteIterations(json, iterations);
+    json << ",\"coarse_iterations\":";
+    WriteIterations(json, coarseIterations);
+
+    json << "}";
+    return json.str();
+}
+
+void WriteIterations(std::ostringstream& json, const std::vector<IterationStats>& iterations) {
+    json << "[";
+
+    for (size_t i = 0; i < iterations.size(); i++) {
+        const IterationStats& iteration = iterations[i];
+
+        json << (i ? "," : "") << "{\"ms\":" << iteration.milliseconds << ",\"changed_labels\":" << iteration.changedLabels
+            << ",\"distance_evaluations\":" << iteration.distanceEvaluations << ",\"residual\":" << iteration.residual
+            << ",\"active_clusters\":" << iteration.activeClusters << "}";
+    }
+
+    json << "]";
+}
+
+void Segmenter::Colorate(cv::Mat& result) const {
+    ColorateClusters(centroids, labels, result, params.useLab);
+}
+
+int GridInterval(const cv::Size& size, const int& superpixels) {
+    const int64 N = (int64)size.width * size.height; // image pixel count, beyond int for the largest mapped images
+    const int64 superpixelArea = N / superpixels; // approximate size of each segment
+
+    return std::max((int)std::sqrt((double)superpixelArea), 1); // one pixel when K exceeds the pixel count
+}
+
+void ConvertToLab(const ImageView& view, cv::Mat& lab) {
+    lab.create(view.size, CV_8UC3);
+    ConvertToLab(view, ImageTarget(lab));
+}
+
+void ConvertToLab(const ImageView& view, const ImageTarget& target) {
+    static const LabTables tables;
+
+    cv::parallel_for_(cv::Range(0, view.size.height), LabConversionBody(view, target, tables));
+}
+
+void CopyChannels(const ImageView& view, const ImageTarget& target) {
+
+    for (int y = 0; y < view.size.height; y++) {
+        for (int c = 0; c < 3; c++) {
+            const uchar* sourceRow = view.channels[c] + y * view.rowStep;
+            uchar* targetRow = target.channels[c] + y * target.rowStep;
+
+            for (int x = 0; x < view.size.width; x++)
+                targetRow[(size_t)x * target.pixelStep] = sourceRow[(size_t)x * view.pixelStep];
+        }
+    }
+}
+
+void LabConversionBody::operator()(const cv::Range& range) const {
+
+    // sRGB (D65) to XYZ, with the X and Z rows already divided by the reference white
+    const float m00 = 0.412453f / 0.950456f, m01 = 0.357580f / 0.950456f, m02 = 0.180423f / 0.950456f;
+    const float m10 = 0.212671f, m11 = 0.715160f, m12 = 0.072169f;
+    const float m20 = 0.019334f / 1.088754f, m21 = 0.119193f / 1.088754f, m22 = 0.950227f / 1.088754f;
+
+    const int chunk = 64;
+    const int cols = view.size.width;
+    const int step = view.pixelStep;
+
+    float r[chunk], g[chunk], b[chunk];
+
+    for (int y = range.start; y < range.end; y++) {
+        const uchar* bRow = view.channels[0] + y * view.rowStep;
+        const uchar* gRow = view.channels[1] + y * view.rowStep;
+        const uchar* rRow = view.channels[2] + y * view.rowStep;
+        uchar* lRow = target.channels[0] + y * target.rowStep;
+        uchar* aRow = target.channels[1] + y * target.rowStep;
+        uchar* bStarRow = target.channels[2] + y * target.rowStep; // b* of CIELAB, not blue
+
+        for (int from = 0; from < cols; from += chunk) {
+            const int n = std::min(chunk, cols - from);
+
+            // the channels are gathered with their own step, so any interleaved or planar layout reads in place
+            for (int i = 0; i < n; i++) {
+                const size_t offset = (size_t)(from + i) * step;
+
+                b[i] = tables.gamma[bRow[offset]];
+                g[i] = tables.gamma[gRow[offset]];
+                r[i] = tables.gamma[rRow[offset]];
+            }
+
+            // the linear values are replaced in place by X, Y, Z
+            int i = 0;
+
+#if SLIC_SIMD
+            const int floatLanes = cv::v_float32::nlanes;
+
+            for (; i <= n - floatLanes; i += floatLanes) {
+                const cv::v_float32 vR = cv::vx_load(r + i), vG = cv::vx_load(g + i), vB = cv::vx_load(b + i);
+
+                cv::vx_store(r + i, vR * cv::vx_setall_f32(m00) + vG * cv::vx_setall_f32(m01) + vB * cv::vx_setall_f32(m02));
+                cv::vx_store(g + i, vR * cv::vx_setall_f32(m10) + vG * cv::vx_setall_f32(m11) + vB * cv::vx_setall_f32(m12));
+                cv::vx_store(b + i, vR * cv::vx_setall_f32(m20) + vG * cv::vx_setall_f32(m21) + vB * cv::vx_setall_f32(m22));
+            }
+            cv::vx_cleanup();
+#endif
+
+            for (; i < n; i++) {
+                const float vR = r[i], vG = g[i], vB = b[i];
+
+                r[i] = vR * m00 + vG * m01 + vB * m02;
+                g[i] = vR * m10 + vG * m11 + vB * m12;
+                b[i] = vR * m20 + vG * m21 + vB * m22;
+            }
+
+            // same 8-bit scaling as OpenCV's CV_8UC3 Lab: L * 255 / 100, a + 128, b + 128
+            for (i = 0; i < n; i++) {
+                const float fx = tables.Compand(r[i]);
+                const float fy = tables.Compand(g[i]);
+                const float fz = tables.Compand(b[i]);
+
+                const size_t offset = (size_t)(from + i) * target.pixelStep;
+
+                lRow[offset] = cv::saturate_cast<uchar>((116.f * fy - 16.f) * 2.55f);
+                aRow[offset] = cv::saturate_cast<uchar>(500.f * (fx - fy) + 128.f);
+                bStarRow[offset] = cv::saturate_cast<uchar>(200.f * (fy - fz) + 128.f);
+            }
+        }
+    }
+}
+
+float PixelGradient(const cv::Vec3b& left, const cv::Vec3b& right, const cv::Vec3b& up, const cv::Vec3b& down) {
+
+    int xSum = 0, ySum = 0, xDiff, yDiff;
+    for (int i = 0; i < 3; i++) {
+        xDiff = right[i] - left[i];
+        yDiff = down[i] - up[i];
+
+        xSum += xDiff * xDiff;
+        ySum += yDiff * yDiff;
+    }
+
+    return std::sqrt((float)xSum) + std::sqrt((float)ySum);
+}
+
+void ComputeGradients(const PlanarImage& img, cv::Mat& gradients) {
+    gradients.create(img.Size(), CV_32FC1);
+    cv::parallel_for_(cv::Range(0, img.Rows()), GradientBody(img, gradients));
+}
+
+void ChooseInitialCentroids(const PlanarImage& img, const cv::Mat& gradients, std::vector<ColoredPoint>& centers, const int& S) {
+    const int start = S / 2;
+
+    for (int y = start; y < img.Rows(); y += S)
+        for (int x = start; x < img.Cols(); x += S)
+            centers.push_back(PerturbSeed(img, gradients, x, y));
+}
+
+int GridSeedCount(const cv::Size& size, const int& S) {
+    const int start = S / 2;
+
+    // the number of grid points ChooseInitialCentroids() visits
+    const int rows = size.height > start ? (size.height - start + S - 1) / S : 0;
+    const int cols = size.width > start ? (size.width - start + S - 1) / S : 0;
+
+    return rows * cols;
+}
+
+ColoredPoint PerturbSeed(const PlanarImage& img, const cv::Mat& gradients, const int& x, const int& y) {
+    int minX = -1, minY = -1;
+    float minGradient = std::numeric_limits<float>::max(), grad;
+
+    const int rows = img.Rows();
+    const int cols = img.Cols();
+
+    // the 3x3 neighbourhood is clipped, so seeds next to the border stay inside the image
+    for (int i = std::max(x - 1, 0); i <= std::min(x + 1, cols - 1); i++) {
+
+        for (int j = std::max(y - 1, 0); j <= std::min(y + 1, rows - 1); j++) {
+
+            grad = gradients.at<float>(j, i);
+
+            if (grad < minGradient) {
+                minGradient = grad;
+                minX = i;
+                minY = j;
+            }
+        }
+    }
+
+    return ColoredPoint(img.At(minY, minX), minX, minY);
+}
+
+DistanceMetric MakeDistanceMetric(const int& S, const int& m, const DistanceMode& mode) {
+    DistanceMetric metric;
+
+    metric.mode = mode;
+    metric.spatial = (float)((double)m * m / ((double)S * S));
+
+    // largest color scale for which dc^2 * colorScale + ds^2 * spatialScale cannot overflow,
+    // with dc^2 <= 3 * 255^2 and ds^2 <= 2 * (2S)^2 inside a search window
+    const int64 maxColor = 3 * 255 * 255;
+    const int64 maxSpatial = 8 * (int64)S * S;
+
+    int64 colorScale = INT_MAX / (maxColor + 8 * (int64)m * m), spatialScale;
+    do {
+        spatialScale = (int64)std::llround(colorScale * (double)metric.spatial);
+    } while (colorScale * maxColor + spatialScale * maxSpatial > INT_MAX && --colorScale > 0);
+
+    metric.colorScale = (int)colorScale;
+    metric.spatialScale = (int)spatialScale;
+
+    // a spatial scale below 50 rounds the weight by more than 1%, and by all of it once it is 0,
+    // so grids that coarse are measured in floats instead
+    const int64 minSpatialScale = 50;
+
+    if (mode == DistanceMode::Fixed && m > 0 && spatialScale < minSpatialScale)
+        metric.mode = DistanceMode::Float;
+
+    CV_Assert(metric.mode != DistanceMode::Fixed || m <= 0 || metric.spatialScale > 0);
+    return metric;
+}
+
+void AssignToNearestCentroids(const PlanarImage& img, const std::vector<ColoredPoint>& centroids, cv::Mat& labels, cv::Mat& distances, const int& S, const DistanceMetric& metric, const ActiveSet& activeSet, CentroidGrid& grid, const AdaptiveCompactness* adaptive, const int& threads) {
+    distances.create(img.Size(), metric.mode == DistanceMode::Fixed ? CV_32SC1 : CV_32FC1);
+
+    BuildCentroidGrid(grid, centroids, img.Size(), S);
+
+    // more bands than threads keeps the workers busy when the bands near the borders finish early
+    cv::parallel_for_(cv::Range(0, img.Rows()), AssignmentBody(img, labels, distances, S, metric, activeSet, grid, adaptive), 4 * threads);
+}
+
+void BuildCentroidGrid(CentroidGrid& grid, const std::vector<ColoredPoint>& centroids, const cv::Size& size, const int& S) {
+    const int count = (int)centroids.size();
+
+    grid.cellSize = S;
+    grid.cols = (size.width + S - 1) / S;
+    grid.rows = (size.height + S - 1) / S;
+
+    const int cells = grid.cols * grid.rows;
+
+    // count the clusters of every cell one slot ahead, so the prefix sum yields the first offsets
+    grid.cellStart.assign(cells + 1, 0);
+
+    for (const ColoredPoint& centroid : centroids)
+        grid.cellStart[(centroid.y / S) * grid.cols + centroid.x / S + 1]++;
+
+    for (int c = 0; c < cells; c++)
+        grid.cellStart[c + 1] += grid.cellStart[c];
+
+    // filling advances every offset to the start of the next cell, which is undone afterwards
+    grid.members.resize(count);
+
+    for (int k = 0; k < count; k++)
+        grid.members[grid.cellStart[(centroids[k].y / S) * grid.cols + centroids[k].x / S]++] = k;
+
+    for (int c = cells; c > 0; c--)
+        grid.cellStart[c] = grid.cellStart[c - 1];
+
+    grid.cellStart[0] = 0;
+
+    // a band walks a contiguous range of members, so their coordinates are gathered in that order
+    std::vector<int>* coordinates[] = { &grid.cx, &grid.cy, &grid.c0, &grid.c1, &grid.c2 };
+
+    for (std::vector<int>* coordinate : coordinates)
+        coordinate->resize(count);
+
+    for (int i = 0; i < count; i++) {
+        const ColoredPoint& centroid = centroids[grid.members[i]];
+
+        grid.cx[i] = centroid.x;
+        grid.cy[i] = centroid.y;
+        grid.c0[i] = centroid.color[0];
+        grid.c1[i] = centroid.color[1];
+        grid.c2[i] = centroid.color[2];
+    }
+}
+
+void AssignmentBody::operator()(const cv::Range& range) const {
+
+    const int threshold = 2 * S;
+    const int cols = img.Cols();
+    const bool fixed = metric.mode == DistanceMode::Fixed;
+    const int cellSize = activeSet.cellSize;
+
+    // pixels owned by a moved cluster start over, all others keep their distance to a centroid
+    // that has not changed; such pixels can only lie in the dirty cells around the moved clusters
+    for (int y = range.start; y < range.end; y++) {
+        int* labelRow = labels.ptr<int>(y);
+        const uchar* cellRow = activeSet.dirty.ptr<uchar>(y / cellSize);
+
+        for (int cell = 0; cell < activeSet.dirty.cols; cell++) {
+            if (!activeSet.full && !cellRow[cell])
+                continue;
+
+            const int fromX = cell * cellSize;
+            const int toX = std::min(fromX + cellSize, cols);
+
+            for (int x = fromX; x < toX; x++) {
+                if (!activeSet.full && (labelRow[x] < 0 || !activeSet.moved[labelRow[x]]))
+                    continue;
+
+                labelRow[x] = -1;
+
+                if (fixed)
+                    distances.ptr<int>(y)[x] = std::numeric_limits<int>::max();
+                else
+                    distances.ptr<float>(y)[x] = std::numeric_limits<float>::max();
+            }
+        }
+    }
+
+    // only the cell rows within 2S of the band hold centroids whose window reaches it
+    const int fromRow = std::max(range.start - threshold, 0) / grid.cellSize;
+    const int toRow = std::min((range.end - 1 + threshold) / grid.cellSize, grid.rows - 1);
+
+    // every centroid only sweeps its own 2S window, so the cost does not depend on the number of centroids
+    for (int i = grid.cellStart[fromRow * grid.cols]; i < grid.cellStart[(toRow + 1) * grid.cols]; i++) {
+        const int k = grid.members[i];
+
+        if (!activeSet.active[k])
+            continue;
+
+        const int fromX = std::max(grid.cx[i] - threshold, 0);
+        const int toX = std::min(grid.cx[i] + threshold, cols - 1);
+        const int fromY = std::max(grid.cy[i] - threshold, range.start);
+        const int toY = std::min(grid.cy[i] + threshold, range.end - 1);
+
+        // SLICO scales both terms by the cluster's own maxima, plain SLIC only the spatial one
+        const float colorWeight = adaptive ? adaptive->colorWeights[k] : 1.f;
+        const float spatialWeight = adaptive ? adaptive->spatialWeights[k] : metric.spatial;
+
+        for (int y = fromY; y <= toY; y++) {
+            const uchar* channelRows[3] = { img.planes[0].ptr<uchar>(y), img.planes[1].ptr<uchar>(y), img.planes[2].ptr<uchar>(y) };
+
+            if (fixed)
+                AssignSpanFixed(channelRows, distances.ptr<int>(y), labels.ptr<int>(y), fromX, toX, y, grid, i, metric);
+            else
+                AssignSpan(channelRows, distances.ptr<float>(y), labels.ptr<int>(y), fromX, toX, y, grid, i, colorWeight, spatialWeight);
+        }
+    }
+}
+
+void InitActiveSet(ActiveSet& set, const cv::Size& size, const int& count, const int& S) {
+    set.moved.assign(count, 1);
+    set.active.assign(count, 1);
+    set.cellSize = S;
+    set.dirty.create((size.height + S - 1) / S, (size.width + S - 1) / S, CV_8UC1);
+    set.dirty = cv::Scalar(1);
+    set.relabeled.create(set.dirty.size(), CV_8UC1);
+    set.relabeled = cv::Scalar(1);
+    set.activeCount = count;
+    set.full = true;
+}
+
+void MarkWindowCells(cv::Mat& cells, const ColoredPoint& centroid, const int& S, const int& cellSize) {
+    const int threshold = 2 * S;
+
+    const int fromX = std::max(centroid.x - threshold, 0) / cellSize;
+    const int toX = std::min(centroid.x + threshold, cells.cols * cellSize - 1) / cellSize;
+    const int fromY = std::max(centroid.y - threshold, 0) / cellSize;
+    const int toY = std::min(centroid.y + threshold, cells.rows * cellSize - 1) / cellSize;
+
+    for (int y = fromY; y <= toY; y++)
+        std::fill(cells.ptr<uchar>(y) + fromX, cells.ptr<uchar>(y) + toX + 1, 1);
+}
+
+bool WindowTouchesCells(const cv::Mat& cells, const ColoredPoint& centroid, const int& S, const int& cellSize) {
+    const int threshold = 2 * S;
+
+    const int fromX = std::max(centroid.x - threshold, 0) / cellSize;
+    const int toX = std::min(centroid.x + threshold, cells.cols * cellSize - 1) / cellSize;
+    const int fromY = std::max(centroid.y - threshold, 0) / cellSize;
+    const int toY = std::min(centroid.y + threshold, cells.rows * cellSize - 1) / cellSize;
+
+    for (int y = fromY; y <= toY; y++) {
+        const uchar* cellRow = cells.ptr<uchar>(y);
+
+        for (int x = fromX; x <= toX; x++)
+            if (cellRow[x])
+                return true;
+    }
+
+    return false;
+}
+
+int UpdateActiveSet(ActiveSet& set, const std::vector<ColoredPoint>& previous, const std::vector<ColoredPoint>& current, const int& S, const int& tolerance, const std::vector<uchar>* reweighted) {
+    const int count = (int)current.size();
+
+    set.dirty = cv::Scalar(0);
+    set.full = false;
+
+    for (int k = 0; k < count; k++) {
+        const ColoredPoint& from = previous[k];
+        const ColoredPoint& to = current[k];
+
+        int change = abs(from.x - to.x) + abs(from.y - to.y);
+        for (int i = 0; i < 3; i++)
+            change = std::max(change, abs(from.color[i] - to.color[i]));
+
+        // new weights change the distances of a cluster just like a new position
+        set.moved[k] = change > tolerance || (reweighted && (*reweighted)[k]);
+
+        if (set.moved[k]) {
+            MarkWindowCells(set.dirty, from, S, set.cellSize);
+            MarkWindowCells(set.dirty, to, S, set.cellSize);
+        }
+    }
+
+    set.activeCount = 0;
+    set.dirty.copyTo(set.relabeled);
+
+    // an active cluster that moved within the tolerance can still take pixels anywhere in its window
+    for (int k = 0; k < count; k++) {
+        set.active[k] = set.moved[k] || WindowTouchesCells(set.dirty, current[k], S, set.cellSize);
+        set.activeCount += set.active[k];
+
+        if (set.active[k])
+            MarkWindowCells(set.relabeled, current[k], S, set.cellSize);
+    }
+
+    return set.activeCount;
+}
+
+void InitAdaptiveCompactness(AdaptiveCompactness& adaptive, const int& count, const int& S) {
+
+    // the starting maxima of the reference SLICO, a color distance of 10 and the grid interval
+    adaptive.maxColor.assign(count, 10.f * 10.f);
+    adaptive.maxSpatial.assign(count, (float)S * S);
+    adaptive.colorWeights.assign(count, 1.f / (10.f * 10.f));
+    adaptive.spatialWeights.assign(count, 1.f / ((float)S * S));
+    adaptive.changed.assign(count, 0);
+}
+
+void UpdateAdaptiveCompactness(const PlanarImage& img, const cv::Mat& labels, const std::vector<ColoredPoint>& centroids, AdaptiveCompactness& adaptive, const int& threads) {
+    const int count = (int)centroids.size();
+
+    // two maxima per cluster and stripe, merged below
+    adaptive.stripeMaxima.assign((size_t)threads * count * 2, 0.f);
+    cv::parallel_for_(cv::Range(0, threads), MaximaBody(img, labels, centroids, adaptive.stripeMaxima, threads), threads);
+
+    for (int k = 0; k < count; k++) {
+        float maxColor = adaptive.maxColor[k], maxSpatial = adaptive.maxSpatial[k];
+
+        for (int stripe = 0; stripe < threads; stripe++) {
+            const float* stripeMaxima = &adaptive.stripeMaxima[((size_t)stripe * count + k) * 2];
+
+            maxColor = std::max(maxColor, stripeMaxima[0]);
+            maxSpatial = std::max(maxSpatial, stripeMaxima[1]);
+        }
+
+        adaptive.changed[k] = maxColor != adaptive.maxColor[k] || maxSpatial != adaptive.maxSpatial[k];
+
+        if (adaptive.changed[k]) {
+            adaptive.maxColor[k] = maxColor;
+            adaptive.maxSpatial[k] = maxSpatial;
+            adaptive.colorWeights[k] = 1.f / maxColor;
+            adaptive.spatialWeights[k] = 1.f / maxSpatial;
+        }
+    }
+}
+
+void MaximaBody::operator()(const cv::Range& range) const {
+
+    const int rows = img.Rows();
+    const int cols = img.Cols();
+    const int count = (int)centroids.size();
+
+    for (int stripe = range.start; stripe < range.end; stripe++) {
+        float* maxima = &stripeMaxima[(size_t)stripe * count * 2];
+
+        const int fromY = rows * stripe / stripes;
+        const int toY = rows * (stripe + 1) / stripes;
+
+        for (int y = fromY; y < toY; y++) {
+            const uchar* bRow = img.planes[0].ptr<uchar>(y);
+            const uchar* gRow = img.planes[1].ptr<uchar>(y);
+            const uchar* rRow = img.planes[2].ptr<uchar>(y);
+            const int* labelRow = labels.ptr<int>(y);
+
+            for (int x = 0; x < cols; x++) {
+                const int k = labelRow[x];
+
+                if (k < 0)
+                    continue;
+
+                const ColoredPoint& centroid = centroids[k];
+
+                const float bDiff = (float)(bRow[x] - centroid.color[0]);
+                const float gDiff = (float)(gRow[x] - centroid.color[1]);
+                const float rDiff = (float)(rRow[x] - centroid.color[2]);
+                const float xDiff = (float)(x - centroid.x);
+                const float yDiff = (float)(y - centroid.y);
+
+                maxima[k * 2] = std::max(maxima[k * 2], bDiff * bDiff + gDiff * gDiff + rDiff * rDiff);
+                maxima[k * 2 + 1] = std::max(maxima[k * 2 + 1], xDiff * xDiff + yDiff * yDiff);
+            }
+        }
+    }
+}
+
+#if SLIC_SIMD
+void WidenChannel(const cv::v_uint8& channel, cv::v_int32 wide[4]) {
+    cv::v_uint16 half[2];
+    cv::v_expand(channel, half[0], half[1]);
+
+    for (int i = 0; i < 2; i++) {
+        cv::v_uint32 quarter[2];
+        cv::v_expand(half[i], quarter[0], quarter[1]);
+
+        wide[2 * i] = cv::v_reinterpret_as_s32(quarter[0]);
+        wide[2 * i + 1] = cv::v_reinterpret_as_s32(quarter[1]);
+    }
+}
+
+void LoadChannel(const uchar* values, cv::v_int32 wide[4]) {
+    WidenChannel(cv::vx_load(values), wide);
+}
+#endif
+
+void GradientBody::operator()(const cv::Range& range) const {
+
+    const int rows = img.Rows();
+    const int cols = img.Cols();
+
+    for (int y = range.start; y < range.end; y++) {
+        const int up = std::max(y - 1, 0);
+        const int down = std::min(y + 1, rows - 1);
+        float* gradientRow = gradients.ptr<float>(y);
+
+        // the first and last columns replicate their neighbour outside the image
+        int x = 0;
+        gradientRow[x] = PixelGradient(img.At(y, x), img.At(y, std::min(x + 1, cols - 1)), img.At(up, x), img.At(down, x));
+
+        x = 1;
+
+#if SLIC_SIMD
+        const int lanes = cv::v_uint8::nlanes;
+        const int floatLanes = cv::v_float32::nlanes;
+
+        for (; x <= cols - 1 - lanes; x += lanes) {
+            cv::v_int32 xSums[4], ySums[4];
+
+            for (int quarter = 0; quarter < 4; quarter++)
+                xSums[quarter] = ySums[quarter] = cv::vx_setzero_s32();
+
+            // the channels are summed one plane at a time
+            for (int c = 0; c < 3; c++) {
+                const uchar* planeRow = img.planes[c].ptr<uchar>(y);
+                cv::v_int32 left[4], right[4], above[4], below[4];
+
+                LoadChannel(planeRow + x - 1, left);
+                LoadChannel(planeRow + x + 1, right);
+                LoadChannel(img.planes[c].ptr<uchar>(up) + x, above);
+                LoadChannel(img.planes[c].ptr<uchar>(down) + x, below);
+
+                for (int quarter = 0; quarter < 4; quarter++) {
+                    const cv::v_int32 xDiff = right[quarter] - left[quarter];
+                    const cv::v_int32 yDiff = below[quarter] - above[quarter];
+
+                    xSums[quarter] += xDiff * xDiff;
+                    ySums[quarter] += yDiff * yDiff;
+                }
+            }
+
+            for (int quarter = 0; quarter < 4; quarter++)
+                cv::vx_store(gradientRow + x + quarter * floatLanes, cv::v_sqrt(cv::v_cvt_f32(xSums[quarter])) + cv::v_sqrt(cv::v_cvt_f32(ySums[quarter])));
+        }
+        cv::vx_cleanup();
+#endif
+
+        for (; x < cols; x++)
+            gradientRow[x] = PixelGradient(img.At(y, x - 1), img.At(y, std::min(x + 1, cols - 1)), img.At(up, x), img.At(down, x));
+    }
+}
+
+void AssignSpan(const uchar* const channelRows[3], float* distanceRow, int* labelRow, const int& fromX, const int& toX, const int& y, const CentroidGrid& grid, const int& member, const float& colorWeight, const float& spatialWeight) {
+    const uchar* bRow = channelRows[0];
+    const uchar* gRow = channelRows[1];
+    const uchar* rRow = channelRows[2];
+
+    const int label = grid.members[member];
+    const int centroidX = grid.cx[member];
+    const float b = (float)grid.c0[member], g = (float)grid.c1[member], r = (float)grid.c2[member];
+    const float yDiff = (float)(y - grid.cy[member]);
+    const float yDiff2 = yDiff * yDiff;
+
+    int x = fromX;
+
+#if SLIC_SIMD
+    const int lanes = cv::v_uint8::nlanes;
+    const int floatLanes = cv::v_float32::nlanes;
+
+    float offsets[cv::v_float32::nlanes];
+    for (int i = 0; i < floatLanes; i++)
+        offsets[i] = (float)i;
+
+    const cv::v_float32 vOffsets = cv::vx_load(offsets);
+    const cv::v_float32 vB = cv::vx_setall_f32(b), vG = cv::vx_setall_f32(g), vR = cv::vx_setall_f32(r);
+    const cv::v_float32 vYDiff2 = cv::vx_setall_f32(yDiff2);
+    const cv::v_float32 vColorWeight = cv::vx_setall_f32(colorWeight);
+    const cv::v_float32 vWeight = cv::vx_setall_f32(spatialWeight);
+    const cv::v_int32 vLabel = cv::vx_setall_s32(label);
+
+    // one load per plane covers 'lanes' pixels, widened to four vectors per channel
+    for (; x <= toX - lanes + 1; x += lanes) {
+        cv::v_int32 b32[4], g32[4], r32[4];
+        LoadChannel(bRow + x, b32);
+        LoadChannel(gRow + x, g32);
+        LoadChannel(rRow + x, r32);
+
+        for (int quarter = 0; quarter < 4; quarter++) {
+            const int offset = x + quarter * floatLanes;
+
+            const cv::v_float32 bDiff = cv::v_cvt_f32(b32[quarter]) - vB;
+            const cv::v_float32 gDiff = cv::v_cvt_f32(g32[quarter]) - vG;
+            const cv::v_float32 rDiff = cv::v_cvt_f32(r32[quarter]) - vR;
+            const cv::v_float32 xDiff = cv::vx_setall_f32((float)(offset - centroidX)) + vOffsets;
+
+            const cv::v_float32 distance = vColorWeight * (bDiff * bDiff + gDiff * gDiff + rDiff * rDiff) + vWeight * (xDiff * xDiff + vYDiff2);
+
+            const cv::v_float32 best = cv::vx_load(distanceRow + offset);
+            const cv::v_int32 owner = cv::vx_load(labelRow + offset);
+            const cv::v_float32 nearer = (distance < best) | ((distance == best) & cv::v_reinterpret_as_f32(vLabel < owner));
+
+            cv::vx_store(distanceRow + offset, cv::v_select(nearer, distance, best));
+            cv::vx_store(labelRow + offset, cv::v_select(cv::v_reinterpret_as_s32(nearer), vLabel, owner));
+        }
+    }
+    cv::vx_cleanup();
+#endif
+
+    for (; x <= toX; x++) {
+        const float bDiff = bRow[x] - b;
+        const float gDiff = gRow[x] - g;
+        const float rDiff = rRow[x] - r;
+        const float xDiff = (float)(x - centroidX);
+
+        const float distance = colorWeight * (bDiff * bDiff + gDiff * gDiff + rDiff * rDiff) + spatialWeight * (xDiff * xDiff + yDiff2);
+
+        // equal distances go to the lower label, so the owner does not depend on the order the centroids sweep in
+        if (distance < distanceRow[x] || (distance == distanceRow[x] && label < labelRow[x])) {
+            distanceRow[x] = distance;
+            labelRow[x] = label;
+        }
+    }
+}
+
+void AssignSpanFixed(const uchar* const channelRows[3], int* distanceRow, int* labelRow, const int& fromX, const int& toX, const int& y, const CentroidGrid& grid, const int& member, const DistanceMetric& metric) {
+    const uchar* bRow = channelRows[0];
+    const uchar* gRow = channelRows[1];
+    const uchar* rRow = channelRows[2];
+
+    const int label = grid.members[member];
+    const int centroidX = grid.cx[member];
+    const int b = grid.c0[member], g = grid.c1[member], r = grid.c2[member];
+    const int yDiff = y - grid.cy[member];
+    const int yDiff2 = yDiff * yDiff;
+    const int colorScale = metric.colorScale;
+    const int spatialScale = metric.spatialScale;
+
+    int x = fromX;
+
+#if SLIC_SIMD
+    const int lanes = cv::v_uint8::nlanes;
+    const int intLanes = cv::v_int32::nlanes;
+
+    int offsets[cv::v_int32::nlanes];
+    for (int i = 0; i < intLanes; i++)
+        offsets[i] = i;
+
+    const cv::v_int32 vOffsets = cv::vx_load(offsets);
+    const cv::v_int32 vB = cv::vx_setall_s32(b), vG = cv::vx_setall_s32(g), vR = cv::vx_setall_s32(r);
+    const cv::v_int32 vYDiff2 = cv::vx_setall_s32(yDiff2);
+    const cv::v_int32 vColorScale = cv::vx_setall_s32(colorScale);
+    const cv::v_int32 vSpatialScale = cv::vx_setall_s32(spatialScale);
+    const cv::v_int32 vLabel = cv::vx_setall_s32(label);
+
+    for (; x <= toX - lanes + 1; x += lanes) {
+        cv::v_int32 b32[4], g32[4], r32[4];
+        LoadChannel(bRow + x, b32);
+        LoadChannel(gRow + x, g32);
+        LoadChannel(rRow + x, r32);
+
+        for (int quarter = 0; quarter < 4; quarter++) {
+            const int offset = x + quarter * intLanes;
+
+            const cv::v_int32 bDiff = b32[quarter] - vB;
+            const cv::v_int32 gDiff = g32[quarter] - vG;
+            const cv::v_int32 rDiff = r32[quarter] - vR;
+            const cv::v_int32 xDiff = cv::vx_setall_s32(offset - centroidX) + vOffsets;
+
+            const cv::v_int32 distance = (bDiff * bDiff + gDiff * gDiff + rDiff * rDiff) * vColorScale + (xDiff * xDiff + vYDiff2) * vSpatialScale;
+
+            const cv::v_int32 best = cv::vx_load(distanceRow + offset);
+            const cv::v_int32 owner = cv::vx_load(labelRow + offset);
+            const cv::v_int32 nearer = (distance < best) | ((distance == best) & (vLabel < owner));
+
+            cv::vx_store(distanceRow + offset, cv::v_select(nearer, distance, best));
+            cv::vx_store(labelRow + offset, cv::v_select(nearer, vLabel, owner));
+        }
+    }
+    cv::vx_cleanup();
+#endif
+
+    for (; x <= toX; x++) {
+        const int bDiff = bRow[x] - b;
+        const int gDiff = gRow[x] - g;
+        const int rDiff = rRow[x] - r;
+        const int xDiff = x - centroidX;
+
+        const int distance = (bDiff * bDiff + gDiff * gDiff + rDiff * rDiff) * colorScale + (xDiff * xDiff + yDiff2) * spatialScale;
+
+        if (distance < distanceRow[x] || (distance == distanceRow[x] && label < labelRow[x])) {
+            distanceRow[x] = distance;
+            labelRow[x] = label;
+        }
+    }
+}
+
+void UpdateAccumulators(const PlanarImage& img, const cv::Mat& labels, cv::Mat& previousLabels, const ActiveSet& activeSet, ClusterAccumulator* accumulators, const int& count, const UpdateMode& mode, const bool& restart, const int& threads) {
+
+    // the first 'count' accumulators hold the cluster sums, followed by one scratch slice per thread
+    std::fill(accumulators + count, accumulators + (size_t)count * (threads + 1), ClusterAccumulator());
+
+    if (mode == UpdateMode::Full || restart) {
+        std::fill(accumulators, accumulators + count, ClusterAccumulator());
+        cv::parallel_for_(cv::Range(0, threads), AccumulationBody(img, labels, accumulators, count, threads), threads);
+
+        if (mode == UpdateMode::Incremental)
+            labels.copyTo(previousLabels);
+    }
+    else {
+        // only the pixels that changed owner move between the running sums
+        cv::parallel_for_(cv::Range(0, threads), LabelChangeBody(img, labels, previousLabels, activeSet, accumulators, count, threads), threads);
+    }
+
+    for (int stripe = 1; stripe <= threads; stripe++)
+        for (int k = 0; k < count; k++)
+            accumulators[k] += accumulators[stripe * count + k];
+}
+
+void RecalculateCentroids(std::vector<ColoredPoint>& tempCentroids, const std::vector<ColoredPoint>& centroids, const ClusterAccumulator* accumulators) {
+
+    tempCentroids.clear();
+
+    double coefficient;
+    const int count = (int)centroids.size();
+
+    for (int k = 0; k < count; k++) {
+        const ClusterAccumulator& sum = accumulators[k];
+
+        // a cluster that lost all of its pixels keeps its previous position
+        if (sum.count == 0) {
+            tempCentroids.push_back(centroids[k]);
+            continue;
+        }
+
+        coefficient = 1 / (double)sum.count;
+
+        tempCentroids.emplace_back(cv::Vec3b((uchar)(sum.b * coefficient), (uchar)(sum.g * coefficient), (uchar)(sum.r * coefficient)), (int)(sum.x * coefficient), (int)(sum.y * coefficient));
+    }
+}
+
+void AccumulationBody::operator()(const cv::Range& range) const {
+
+    const int rows = img.Rows();
+    const int cols = img.Cols();
+
+    for (int stripe = range.start; stripe < range.end; stripe++) {
+        ClusterAccumulator* stripeAccumulators = &accumulators[(stripe + 1) * clusters];
+
+        const int fromY = rows * stripe / stripes;
+        const int toY = rows * (stripe + 1) / stripes;
+
+        for (int y = fromY; y < toY; y++) {
+            const uchar* bRow = img.planes[0].ptr<uchar>(y);
+            const uchar* gRow = img.planes[1].ptr<uchar>(y);
+            const uchar* rRow = img.planes[2].ptr<uchar>(y);
+            const int* labelRow = labels.ptr<int>(y);
+
+            for (int x = 0; x < cols; x++)
+                if (labelRow[x] >= 0)
+                    stripeAccumulators[labelRow[x]].Add(x, y, cv::Vec3b(bRow[x], gRow[x], rRow[x]));
+        }
+    }
+}
+
+void LabelChangeBody::operator()(const cv::Range& range) const {
+
+    const int rows = img.Rows();
+    const int cols = img.Cols();
+    const int cellSize = activeSet.cellSize;
+
+    for (int stripe = range.start; stripe < range.end; stripe++) {
+        ClusterAccumulator* stripeAccumulators = &accumulators[(stripe + 1) * clusters];
+
+        const int fromY = rows * stripe / stripes;
+        const int toY = rows * (stripe + 1) / stripes;
+
+        for (int y = fromY; y < toY; y++) {
+            const uchar* bRow = img.planes[0].ptr<uchar>(y);
+            const uchar* gRow = img.planes[1].ptr<uchar>(y);
+            const uchar* rRow = img.planes[2].ptr<uchar>(y);
+            const int* labelRow = labels.ptr<int>(y);
+            int* previousRow = previousLabels.ptr<int>(y);
+            const uchar* cellRow = activeSet.relabeled.ptr<uchar>(y / cellSize);
+
+            for (int cell = 0; cell < activeSet.relabeled.cols; cell++) {
+                if (!activeSet.full && !cellRow[cell])
+                    continue;
+
+                const int toX = std::min((cell + 1) * cellSize, cols);
+
+                for (int x = cell * cellSize; x < toX; x++) {
+                    if (labelRow[x] == previousRow[x])
+                        continue;
+
+                    const cv::Vec3b color(bRow[x], gRow[x], rRow[x]);
+
+                    if (previousRow[x] >= 0)
+                        stripeAccumulators[previousRow[x]].Remove(x, y, color);
+
+                    if (labelRow[x] >= 0)
+                        stripeAccumulators[labelRow[x]].Add(x, y, color);
+
+                    previousRow[x] = labelRow[x];
+                }
+            }
+        }
+    }
+}
+
+int64 GrowSuperpixels(const PlanarImage& img, std::vector<ColoredPoint>& centroids, const std::vector<SeedState>* states, cv::Mat& labels, cv::Mat& queued, const float& spatialWeight, PixelQueue& queue, std::vector<GrowingCluster>& clusters) {
+    CV_Assert(img.planes[0].isContinuous() && img.planes[1].isContinuous() && img.planes[2].isContinuous());
+    CV_Assert(labels.isContinuous() && queued.isContinuous());
+
+    const int count = (int)centroids.size();
+    const int cols = img.Cols(), rows = img.Rows();
+    const uchar* bPixels = img.planes[0].ptr<uchar>();
+    const uchar* gPixels = img.planes[1].ptr<uchar>();
+    const uchar* rPixels = img.planes[2].ptr<uchar>();
+    int* labelData = labels.ptr<int>();
+    float* queuedData = queued.ptr<float>();
+
+    labels = cv::Scalar(-1);
+    queued = cv::Scalar(std::numeric_limits<float>::max());
+    queue.Clear();
+    clusters.resize(count);
+
+    for (int k = 0; k < count; k++) {
+        const ColoredPoint& seed = centroids[k];
+
+        clusters[k].sums = ClusterAccumulator();
+        clusters[k].x = (float)seed.x;
+        clusters[k].y = (float)seed.y;
+        clusters[k].b = seed.color[0];
+        clusters[k].g = seed.color[1];
+        clusters[k].r = seed.color[2];
+
+        queue.Push(PixelNode{ 0.f, k, seed.x, seed.y });
+    }
+
+    int64 pushes = count;
+
+    const int dx[] = { -1, 1, 0, 0 };
+    const int dy[] = { 0, 0, -1, 1 };
+
+    // a pixel can be queued by several superpixels, the nearest one pops first and takes it
+    while (!queue.Empty()) {
+        const PixelNode node = queue.Pop();
+        const int index = node.y * cols + node.x;
+
+        if (labelData[index] >= 0)
+            continue;
+
+        labelData[index] = node.label;
+
+        GrowingCluster& cluster = clusters[node.label];
+        const cv::Vec3b color(bPixels[index], gPixels[index], rPixels[index]);
+
+        // fixed seeds were settled elsewhere and only compete for pixels
+        if (!states || (*states)[node.label] != SeedState::Fixed) {
+            cluster.sums.Add(node.x, node.y, color);
+
+            const float inverse = 1.f / cluster.sums.count;
+            cluster.x = (float)cluster.sums.x * inverse;
+            cluster.y = (float)cluster.sums.y * inverse;
+            cluster.b = (float)cluster.sums.b * inverse;
+            cluster.g = (float)cluster.sums.g * inverse;
+            cluster.r = (float)cluster.sums.r * inverse;
+        }
+
+        for (int n = 0; n < 4; n++) {
+            const int x = node.x + dx[n], y = node.y + dy[n];
+
+            if (x < 0 || x >= cols || y < 0 || y >= rows || labelData[y * cols + x] >= 0)
+                continue;
+
+            const int neighbour = y * cols + x;
+
+            const float bDiff = bPixels[neighbour] - cluster.b;
+            const float gDiff = gPixels[neighbour] - cluster.g;
+            const float rDiff = rPixels[neighbour] - cluster.r;
+            const float xDiff = x - cluster.x;
+            const float yDiff = y - cluster.y;
+
+            const float distance = bDiff * bDiff + gDiff * gDiff + rDiff * rDiff + spatialWeight * (xDiff * xDiff + yDiff * yDiff);
+            pushes++;
+
+            // a node behind a nearer one for the same pixel could only pop once it is taken
+            if (distance >= queuedData[y * cols + x])
+                continue;
+
+            queuedData[y * cols + x] = distance;
+            queue.Push(PixelNode{ distance, node.label, x, y });
+        }
+    }
+
+    // the final means become the centroids, a seed that never took a pixel keeps its place
+    for (int k = 0; k < count; k++) {
+        const GrowingCluster& cluster = clusters[k];
+
+        if (cluster.sums.count > 0)
+            centroids[k] = ColoredPoint(cv::Vec3b(cv::saturate_cast<uchar>(cluster.b), cv::saturate_cast<uchar>(cluster.g), cv::saturate_cast<uchar>(cluster.r)),
+                cvRound(cluster.x), cvRound(cluster.y));
+    }
+
+    return pushes;
+}
+
+int BitLength(const uint32_t& value) {
+#ifdef _MSC_VER
+    unsigned long index;
+    return _BitScanReverse(&index, value) ? (int)index + 1 : 0;
+#else
+    return value ? 32 - __builtin_clz(value) : 0;
+#endif
+}
+
+uint32_t DistanceKey(const float& distance) {
+    uint32_t key;
+    std::memcpy(&key, &distance, sizeof(key));
+    return key;
+}
+
+void PixelQueue::Clear() {
+    for (std::vector<Entry>& bucket : buckets)
+        bucket.clear();
+
+    last = 0;
+    size = 0;
+}
+
+void PixelQueue::Push(const PixelNode& node) {
+
+    // the growth pops in nearly increasing order, so clamping rarely changes a distance
+    const uint32_t key = std::max(DistanceKey(node.distance), last);
+
+    buckets[BitLength(key ^ last)].push_back(Entry{ key, node.label, node.x, node.y });
+    size++;
+}
+
+PixelNode PixelQueue::Pop() {
+
+    // bucket 0 holds the nodes at exactly the last distance, otherwise the lowest bucket that is
+    // not empty holds the minimum and everything else in it moves closer to the new 'last'
+    if (buckets[0].empty()) {
+        int b = 1;
+
+        while (buckets[b].empty())
+            b++;
+
+        std::vector<Entry>& bucket = buckets[b];
+        uint32_t nearest = bucket[0].key;
+
+        for (const Entry& entry : bucket)
+            nearest = std::min(nearest, entry.key);
+
+        last = nearest;
+
+        for (const Entry& entry : bucket)
+            buckets[BitLength(entry.key ^ last)].push_back(entry);
+
+        bucket.clear();
+    }
+
+    const Entry entry = buckets[0].back();
+    buckets[0].pop_back();
+    size--;
+
+    float distance;
+    std::memcpy(&distance, &entry.key, sizeof(distance));
+
+    return PixelNode{ distance, entry.label, entry.x, entry.y };
+}
+
+void PixelQueue::SnapshotBuffers(std::vector<std::pair<const void*, size_t>>& buffers) const {
+    for (const std::vector<Entry>& bucket : buckets)
+        buffers.emplace_back(bucket.data(), bucket.capacity() * sizeof(Entry));
+}
+
+int EnforceConnectivity(const cv::Mat& labels, cv::Mat& connected, int* segment, const int& minSize) {
+    const int rows = labels.rows;
+    const int cols = labels.cols;
+    const int dx[4] = { -1, 0, 1, 0 };
+    const int dy[4] = { 0, -1, 0, 1 };
+
+    int merged = 0;
+
+    connected.create(labels.size(), CV_32SC1);
+    connected = cv::Scalar(-1);
+
+    // the pixel list doubles as the explicit stack of the flood fill; a fragment is first reached at
+    // its top row, so 'segment' indexes its pixels from there to stay within an int
+
+    for (int y = 0; y < rows; y++) {
+        const int* labelRow = labels.ptr<int>(y);
+        int* connectedRow = connected.ptr<int>(y);
+
+        for (int x = 0; x < cols; x++) {
+            if (connectedRow[x] >= 0)
+                continue;
+
+            const int label = labelRow[x];
+            int adjacent = -1;
+
+            // a finished segment next to the first pixel absorbs this one if it turns out too small
+            for (int i = 0; i < 4; i++) {
+                const int nx = x + dx[i], ny = y + dy[i];
+
+                if (nx >= 0 && nx < cols && ny >= 0 && ny < rows && connected.ptr<int>(ny)[nx] >= 0)
+                    adjacent = connected.ptr<int>(ny)[nx];
+            }
+
+            // pixels no window reached join their neighbour directly
+            if (label < 0) {
+                connectedRow[x] = adjacent;
+                continue;
+            }
+
+            int count = 1;
+            segment[0] = x;
+            connectedRow[x] = label;
+
+            for (int i = 0; i < count; i++) {
+                const int px = segment[i] % cols, py = y + segment[i] / cols;
+
+                for (int j = 0; j < 4; j++) {
+                    const int nx = px + dx[j], ny = py + dy[j];
+
+                    if (nx < 0 || nx >= cols || ny < 0 || ny >= rows)
+                        continue;
+
+                    int& neighbour = connected.ptr<int>(ny)[nx];
+
+                    if (neighbour < 0 && labels.ptr<int>(ny)[nx] == label) {
+                        neighbour = label;
+                        segment[count++] = (ny - y) * cols + nx;
+                    }
+                }
+            }
+
+            if (count >= minSize || adjacent < 0)
+                continue;
+
+            for (int i = 0; i < count; i++)
+                connected.ptr<int>(y + segment[i] / cols)[segment[i] % cols] = adjacent;
+
+            merged++;
+        }
+    }
+
+    return merged;
+}
+
+void ColorateClusters(const std::vector<ColoredPoint>& centroids, const cv::Mat& labels, cv::Mat& img, const bool& lab)
+{
+    const int rows = img.rows;
+    const int cols = img.cols;
+    const int count = (int)centroids.size();
+
+    // centroid colors are in the working color space, only the palette is converted back
+    cv::Mat palette(1, count, CV_8UC3);
+    for (int k = 0; k < count; k++)
+        palette.at<cv::Vec3b>(0, k) = centroids[k].color;
+
+    if (lab)
+        cv::cvtColor(palette, palette, cv::COLOR_Lab2BGR);
+
+    const cv::Vec3b* colors = palette.ptr<cv::Vec3b>(0);
+
+    for (int y = 0; y < rows; y++) {
+        cv::Vec3b* imgRow = img.ptr<cv::Vec3b>(y);
+        const int* labelRow = labels.ptr<int>(y);
+
+        for (int x = 0; x < cols; x++)
+            if (labelRow[x] >= 0)
+                imgRow[x] = colors[labelRow[x]];
+    }
+}
+
+template<typename T>
+bool VectorsEqual(std::vector<T>& v1, std::vector<T>& v2) {
+
+    std::sort(v1.begin(), v1.end());
+    std::sort(v2.begin(), v2.end());
+
+    return v1 == v2;
+}
+
+bool VectorsSimilar(const std::vector<ColoredPoint>& v1, const std::vector<ColoredPoint>& v2, const int threshold, const bool& verbose) {
+
+    const int distance = CentroidResidual(v1, v2);
+
+    if (verbose)
+        std::cout << "Error: " << distance << " [" << threshold << "]" << std::endl;
+    return distance < threshold;
+}
+
+int CentroidResidual(const std::vector<ColoredPoint>& v1, const std::vector<ColoredPoint>& v2) {
+
+    // centroids are compared index by index, the label image refers to them by position
+    int distance = 0, size = (int)v1.size();
+
+    for (int i = 0; i < size; i++)
+        distance += abs(v1[i].x - v2[i].x) + abs(v1[i].y - v2[i].y);
+
+    return distance;
+}
+
+double Lap(std::chrono::high_resolution_clock::time_point& start) {
+    const auto now = std::chrono::high_resolution_clock::now();
+    const double elapsed = std::chrono::duration<double, std::milli>(now - start).count();
+
+    start = now;
+    return elapsed;
+}
+}
\ No newline at end of file
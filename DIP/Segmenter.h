@@ -0,0 +1,364 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <chrono>
+#include <cstdint>
+
+#include <opencv2/core.hpp>
+
+#include "Arena.h"
+
+namespace slic {
+
+struct ColoredPoint {
+    cv::Vec3b color;
+    int x, y;
+
+    ColoredPoint(cv::Vec3b color = cv::Vec3b(0, 0, 0), int x = 0, int y = 0) {
+        this->x = x;
+        this->y = y;
+
+        this->color = color;
+    }
+
+    bool const operator==(const ColoredPoint& p) const {
+        return y == p.y && x == p.x;
+    }
+
+    bool const operator<(const ColoredPoint& p) const {
+        return y < p.y || (y == p.y && x < p.x);
+    }
+};
+
+struct ClusterAccumulator {
+    double x, y, b, g, r;
+    int count;
+
+    ClusterAccumulator& operator+=(const ClusterAccumulator& a) {
+        x += a.x;
+        y += a.y;
+
+        b += a.b;
+        g += a.g;
+        r += a.r;
+
+        count += a.count;
+        return *this;
+    }
+
+    void Add(const int& px, const int& py, const cv::Vec3b& color) {
+        x += px;
+        y += py;
+
+        //B, G, R
+        b += color[0];
+        g += color[1];
+        r += color[2];
+
+        count++;
+    }
+
+    void Remove(const int& px, const int& py, const cv::Vec3b& color) {
+        x -= px;
+        y -= py;
+
+        b -= color[0];
+        g -= color[1];
+        r -= color[2];
+
+        count--;
+    }
+};
+
+enum class UpdateMode {
+    Full,       // re-sum every pixel of every cluster
+    Incremental // move only the pixels whose label changed between the running sums
+};
+
+enum class DistanceMode {
+    Float, // squared distances in single precision
+    Fixed  // squared distances in 32-bit integers with a quantized spatial weight, float where it would round by more than 1%
+};
+
+// Weights of the squared combined distance dc^2 + (m / S)^2 * ds^2, computed once per run.
+// The fixed-point mode evaluates dc^2 * colorScale + ds^2 * spatialScale instead.
+struct DistanceMetric {
+    DistanceMode mode;
+    float spatial;
+    int colorScale, spatialScale;
+};
+
+// Per-cluster convergence state. A cluster is frozen once neither it nor any cluster whose
+// window overlaps its own has moved, and frozen clusters are skipped by the assignment.
+struct ActiveSet {
+    std::vector<uchar> moved, active;
+    cv::Mat dirty; // one flag per S x S cell touched by the old or new window of a moved cluster
+    cv::Mat relabeled; // the dirty cells and those in the window of an active cluster, the only ones a pass can relabel
+    int cellSize;
+    int activeCount;
+    bool full; // every pixel is reassigned, as on the first pass
+};
+
+// Centroids bucketed by the S x S cell of the seeding lattice they lie in, rebuilt by a counting
+// sort before every assignment. The clusters of cell c are members[cellStart[c]] up to
+// members[cellStart[c + 1]] in increasing order, and the cells are stored row by row, so any
+// band of cell rows is one contiguous range of members.
+struct CentroidGrid {
+    int cellSize, cols, rows;
+    std::vector<int> cellStart; // cols * rows + 1 offsets into the members
+    std::vector<int> members;
+    std::vector<int> cx, cy, c0, c1, c2; // position and color of the members in the same order, streamed by the assignment
+};
+
+// Per-cluster normalization of the SLICO distance dc^2 / maxColor + ds^2 / maxSpatial, where
+// the maxima are the largest squared distances a cluster has seen among its pixels so far.
+// Flat arrays indexed by cluster, so the assignment loads two weights per centroid.
+struct AdaptiveCompactness {
+    std::vector<float> maxColor, maxSpatial;
+    std::vector<float> colorWeights, spatialWeights; // reciprocals of the maxima
+    std::vector<float> stripeMaxima; // color and spatial maxima of every stripe before they are merged
+    std::vector<uchar> changed; // clusters whose maxima grew in the last update
+};
+
+enum class Engine {
+    Iterative,    // k-means passes over 2S windows until the centroids settle
+    PriorityQueue // SNIC: one pass growing every superpixel from its seed, nearest pixels first, connected by construction
+};
+
+// Pixel reached by a growing superpixel, keyed by its distance to that superpixel.
+struct PixelNode {
+    float distance;
+    int label;
+    int x, y;
+};
+
+// Monotone min-queue of pixel nodes: a radix heap over the bits of the distances, which order
+// like unsigned integers as long as they are not negative. Nodes only move towards the lower
+// buckets, each at most 32 times and mostly once or twice, and every bucket is appended and
+// scanned in order instead of sifted through like a binary heap. The buckets are the node pool
+// and keep their capacity between runs.
+class PixelQueue {
+public:
+    PixelQueue() : last(0), size(0) {}
+
+    bool Empty() const { return size == 0; }
+    void Clear();
+
+    // A node nearer than the last popped one is queued at that distance instead.
+    void Push(const PixelNode& node);
+    PixelNode Pop();
+
+    void SnapshotBuffers(std::vector<std::pair<const void*, size_t>>& buffers) const;
+
+private:
+    struct Entry {
+        uint32_t key; // bits of the distance
+        int label, x, y;
+    };
+
+    std::vector<Entry> buckets[33]; // bucket b holds the keys whose highest bit that differs from 'last' is b - 1
+    uint32_t last; // key of the last popped node
+    size_t size;
+};
+
+// Running sums of a growing superpixel and their mean, the centroid its next pixels are
+// measured against.
+struct GrowingCluster {
+    ClusterAccumulator sums;
+    float x, y, b, g, r;
+};
+
+enum class SeedState : uchar {
+    Unseeded, // grid position only, moved to the lowest gradient nearby and colored from the image
+    Free,     // starts from the given centroid and is updated like any other
+    Fixed     // settled elsewhere, keeps its position and color and only competes for pixels
+};
+
+// Wall time of the stages of the last Segment() call in milliseconds, with the assignment
+// and update summed over all iterations. The total is the sum of the stages and leaves out
+// the time spent gathering Stats.
+struct StageTimings {
+    double conversion, seeding, assignment, update, connectivity, total;
+};
+
+// Counters of one assignment pass and the update that follows it.
+struct IterationStats {
+    double milliseconds;
+    int64 changedLabels; // pixels whose label differs from the previous pass
+    int64 distanceEvaluations; // pixel-to-centroid distances computed by the assignment
+    int residual; // summed spatial movement of the centroids, the value compared to the threshold
+    int activeClusters; // clusters the assignment swept
+};
+
+// Optional instrumentation of one Segment() call, only gathered when a Stats is passed in.
+struct Stats {
+    int width, height, clusters;
+    StageTimings stages;
+    std::vector<IterationStats> iterations;
+    int allocations; // working buffers that had to be (re)allocated
+    int64 allocatedBytes;
+    int mergedFragments; // disconnected pieces below the minimum size that joined a neighbour
+    std::vector<IterationStats> coarseIterations; // passes on the pyramid level, empty without one
+
+    // One JSON object on a single line.
+    std::string ToJson() const;
+};
+
+// Three 8-bit channels read in place by the conversion, e.g. inside a mapped file. Interleaved
+// pixels have a pixel step of 3 or 4, planar channels a pixel step of 1.
+struct ImageView {
+    cv::Size size;
+    const uchar* channels[3]; // first byte of the blue, green and red channel
+    size_t rowStep; // bytes between two rows
+    int pixelStep; // bytes between two pixels of a row
+
+    ImageView() : channels(), rowStep(0), pixelStep(0) {}
+
+    // Wraps an 8-bit BGR image without copying it.
+    explicit ImageView(const cv::Mat& bgr) : size(bgr.size()), rowStep(bgr.step[0]), pixelStep(3) {
+        CV_Assert(bgr.type() == CV_8UC3);
+
+        for (int c = 0; c < 3; c++)
+            channels[c] = bgr.data + c;
+    }
+
+    // The pixels of 'rect', still read in place with the same steps.
+    ImageView Region(const cv::Rect& rect) const {
+        CV_Assert((rect & cv::Rect(cv::Point(), size)) == rect);
+
+        ImageView region = *this;
+        region.size = rect.size();
+
+        for (int c = 0; c < 3; c++)
+            region.channels[c] += rect.y * rowStep + (size_t)rect.x * pixelStep;
+
+        return region;
+    }
+};
+
+// The working image with every channel in a plane of its own, e.g. L, a and b. A vector load
+// pulls a run of one channel, where interleaved pixels have to be deinterleaved first.
+struct PlanarImage {
+    cv::Mat planes[3];
+
+    cv::Size Size() const { return planes[0].size(); }
+    int Rows() const { return planes[0].rows; }
+    int Cols() const { return planes[0].cols; }
+
+    cv::Vec3b At(const int& y, const int& x) const {
+        return cv::Vec3b(planes[0].at<uchar>(y, x), planes[1].at<uchar>(y, x), planes[2].at<uchar>(y, x));
+    }
+};
+
+struct Params {
+    int superpixels = 15; // number of sectors
+    Engine engine = Engine::Iterative; // k-means iterations or a single priority-queue pass
+    int compactness = 1; // balance between the color and spatial distances
+    bool adaptiveCompactness = false; // SLICO: every cluster weighs by its own largest distances, compactness is unused
+    int threshold = 10; // min alowed distance between clusters to end clustering
+    int threads = 0; // stripes the assignment and update steps are split into, 0 for cv::getNumThreads()
+    bool useLab = true; // cluster in CIELAB instead of the raw BGR values
+    DistanceMode distanceMode = DistanceMode::Float; // float or fixed-point squared distances
+    UpdateMode updateMode = UpdateMode::Incremental; // how the cluster sums follow the labels
+    bool freezeClusters = true; // skip clusters whose neighbourhood stopped moving
+    int freezeTolerance = 0; // largest centroid change that still counts as not moving
+    double minActiveFraction = 0.0; // stop once no more than this fraction of clusters is active
+    int maxIterations = 0; // stop after this many assignment passes, 0 for no limit
+    int pyramidLevels = 0; // halvings of the level the centroids converge on first, 0 to start at full resolution
+    int refinementIterations = 2; // passes at full resolution after the pyramid level, 0 for one assignment
+    bool enforceConnectivity = true; // merge small disconnected fragments into an adjacent superpixel
+    double minFragmentSize = 0.25; // fragments below this fraction of the superpixel area are merged
+    bool verbose = false; // print the centroid movement of every iteration
+};
+
+// Converts 8-bit BGR pixels to the 8-bit CIELAB the segmentation clusters in, so the conversion
+// can run apart from Segment(), which then takes the result with Params::useLab off.
+void ConvertToLab(const ImageView& view, cv::Mat& lab);
+
+// Paints every labeled pixel of 'img' with the color of its centroid, converted back to BGR
+// when the centroids are in CIELAB. Works from copies of Labels() and Centroids().
+void ColorateClusters(const std::vector<ColoredPoint>& centroids, const cv::Mat& labels, cv::Mat& img, const bool& lab);
+
+// Returns the grid interval S of 'superpixels' seeds on an image of 'size', at least one pixel.
+// Callers that seed Segment() themselves have to use the same interval as the grid.
+int GridInterval(const cv::Size& size, const int& superpixels);
+
+// Returns the number of clusters the grid of interval S seeds, which can exceed
+// Params::superpixels by a few rows or columns.
+int GridSeedCount(const cv::Size& size, const int& S);
+
+// Segments BGR images into superpixels. The per-pixel buffers, the cluster sums and the scratch
+// of the connectivity pass and the downsampling are carved from one arena that is rewound
+// between calls and only reallocated when an image needs more than any before it, so one
+// instance should be reused.
+class Segmenter {
+public:
+    explicit Segmenter(const Params& params = Params());
+
+    const Params& GetParams() const { return params; }
+    void SetParams(const Params& params) { this->params = params; }
+
+    // Returns the label of every pixel, valid until the next call. Without 'stats' no counters
+    // are gathered and the iterations run exactly as they would without instrumentation.
+    // With Params::pyramidLevels the grid converges on a downsampled copy first, and only
+    // Params::refinementIterations passes run at full resolution, never unbounded.
+    // Engine::PriorityQueue grows the superpixels from the grid in one pass, with no pyramid.
+    const cv::Mat& Segment(const cv::Mat& bgr, Stats* stats = nullptr);
+
+    // Same as above on pixels that are not held by a cv::Mat, e.g. a memory-mapped file, which
+    // are only read once by the conversion to the working image.
+    const cv::Mat& Segment(const ImageView& view, Stats* stats = nullptr);
+
+    // Starts from 'seeds' in image coordinates instead of the grid for Params::superpixels, with
+    // S as the grid interval, and returns the final centroids in 'seeds'.
+    const cv::Mat& Segment(const cv::Mat& bgr, const int& S, std::vector<ColoredPoint>& seeds, const std::vector<SeedState>& states, Stats* stats = nullptr);
+    const cv::Mat& Segment(const ImageView& view, const int& S, std::vector<ColoredPoint>& seeds, const std::vector<SeedState>& states, Stats* stats = nullptr);
+
+    // Paints every pixel of 'result' with the color of its cluster from the last segmentation.
+    void Colorate(cv::Mat& result) const;
+
+    const cv::Mat& Labels() const { return labels; }
+    const std::vector<ColoredPoint>& Centroids() const { return centroids; }
+    int Iterations() const { return iterations; }
+    const StageTimings& Timings() const { return timings; }
+
+private:
+    const cv::Mat& Run(const ImageView& view, const int& S, const std::vector<ColoredPoint>* seeds, const std::vector<SeedState>* states, const int& maxIterations, Stats* stats);
+    const cv::Mat& RunPyramid(const ImageView& view, const int& S, const int& levels, Stats* stats);
+    void Iterate(const int& S, const std::vector<SeedState>* states, const int& maxIterations, const int& threads, std::chrono::high_resolution_clock::time_point& lap, Stats* stats);
+    void Grow(const std::vector<SeedState>* states, const int& S, std::chrono::high_resolution_clock::time_point& lap, Stats* stats);
+    void RecordAssignment(IterationStats& iteration, const int& S);
+    void PlaceBuffers(const cv::Size& size, const int& S, const int& count, const int& threads);
+    void SnapshotBuffers(std::vector<std::pair<const void*, size_t>>& buffers) const;
+
+    Params params;
+    Arena arena; // backs the per-pixel Mats, the accumulators and the scratch buffers below
+
+    PlanarImage img; // working image the clustering runs on
+    cv::Mat gradients; // gradient magnitude of the working image, read by the seeding
+    cv::Mat labels; // index of the owning centroid for every pixel
+    cv::Mat distances; // squared distance to the owning centroid for every pixel
+    cv::Mat previousLabels; // labels the running cluster sums correspond to
+    std::vector<ColoredPoint> centroids, tempCentroids;
+    ClusterAccumulator* accumulators; // cluster sums followed by one scratch slice per thread
+    ActiveSet activeSet;
+    CentroidGrid grid;
+    AdaptiveCompactness adaptive; // only sized with Params::adaptiveCompactness
+    PixelQueue queue; // pixels waiting to join a superpixel, only used by Engine::PriorityQueue
+    std::vector<GrowingCluster> growing;
+    cv::Mat connectedLabels; // labels after the connectivity pass, swapped with 'labels'
+    int* segment; // indices of the pixels of the fragment being flood filled
+    cv::Mat reportedLabels; // labels of the previous pass, only kept while gathering stats
+    int iterations;
+    StageTimings timings;
+
+    std::unique_ptr<Segmenter> coarse; // segments the pyramid level with buffers of its own
+    cv::Mat coarseImg; // area average of the input at the pyramid level
+    int* downsampleSums; // one row of block sums per stripe of the downsampling
+    std::vector<ColoredPoint> pyramidSeeds; // coarse centroids scaled up to full resolution
+    std::vector<SeedState> pyramidStates;
+};
+
+}
@@ -0,0 +1,311 @@
+#include "stdafx.h"
+
+#include "Segmenter.h"
+#include "Mapped.h"
+
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+
+struct TestImage {
+    std::string name;
+    cv::Mat img;
+};
+
+// A variant of the engine that has to reproduce the labels and centroids of the reference run exactly.
+struct TestCase {
+    std::string name;
+    slic::Params reference, variant;
+};
+
+std::vector<TestImage> MakeImages();
+
+std::vector<TestCase> MakeCases();
+
+std::vector<slic::Params> KernelParams();
+
+bool SameLabels(const cv::Mat& expected, const cv::Mat& actual);
+
+bool SameCentroids(const std::vector<slic::ColoredPoint>& expected, const std::vector<slic::ColoredPoint>& actual);
+
+bool WriteLabels(const std::string& path, const std::vector<TestImage>& images);
+
+bool CompareLabels(const std::string& path, const std::vector<TestImage>& images);
+
+bool CheckMappedFiles();
+
+bool OpensHeader(const std::string& path, const std::string& header, cv::Size& size);
+
+
+int main(int argc, char** argv) {
+    const std::string mode = argc > 1 ? argv[1] : "";
+
+    if (argc != 1 && !(argc == 2 && mode == "--mapped") && !(argc == 3 && (mode == "--write" || mode == "--compare"))) {
+        std::cerr << "Usage: slic_tests [--mapped | --write LABELS | --compare LABELS]\n"
+            << "Without options every update and freezing variant is checked against its reference run.\n"
+            << "--mapped checks the Netpbm headers and the uint16 label files of slic_tiled in the working directory.\n"
+            << "--write stores the labels of the distance kernels, --compare checks a build against them." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (mode == "--mapped")
+        return CheckMappedFiles() ? EXIT_SUCCESS : EXIT_FAILURE;
+
+    const std::vector<TestImage> images = MakeImages();
+
+    if (mode == "--write")
+        return WriteLabels(argv[2], images) ? EXIT_SUCCESS : EXIT_FAILURE;
+
+    if (mode == "--compare")
+        return CompareLabels(argv[2], images) ? EXIT_SUCCESS : EXIT_FAILURE;
+
+    int failures = 0;
+
+    for (const TestCase& test : MakeCases()) {
+        for (const TestImage& image : images) {
+            slic::Segmenter reference(test.reference), variant(test.variant);
+            const bool same = SameLabels(reference.Segment(image.img), variant.Segment(image.img)) && SameCentroids(reference.Centroids(), variant.Centroids());
+
+            std::cout << (same ? "ok   " : "FAIL ") << test.name << " on " << image.name << std::endl;
+            failures += same ? 0 : 1;
+        }
+    }
+
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+std::vector<TestImage> MakeImages() {
+    cv::RNG rng(7);
+    std::vector<TestImage> images(3);
+
+    // odd sizes leave a scalar tail behind every vector loop
+    images[0].name = "noise";
+    images[0].img.create(151, 203, CV_8UC3);
+
+    images[1].name = "gradient";
+    images[1].img.create(240, 321, CV_8UC3);
+
+    images[2].name = "blocks";
+    images[2].img.create(211, 317, CV_8UC3);
+
+    for (int y = 0; y < images[0].img.rows; y++) {
+        cv::Vec3b* imgRow = images[0].img.ptr<cv::Vec3b>(y);
+
+        for (int x = 0; x < images[0].img.cols; x++)
+            imgRow[x] = cv::Vec3b((uchar)rng.uniform(0, 256), (uchar)rng.uniform(0, 256), (uchar)rng.uniform(0, 256));
+    }
+
+    for (int y = 0; y < images[1].img.rows; y++) {
+        cv::Vec3b* imgRow = images[1].img.ptr<cv::Vec3b>(y);
+        const int rows = images[1].img.rows, cols = images[1].img.cols;
+
+        for (int x = 0; x < cols; x++)
+            imgRow[x] = cv::Vec3b((uchar)(255 * x / cols), (uchar)(255 * y / rows), (uchar)(255 * (x + y) / (cols + rows)));
+    }
+
+    // flat regions with mild noise, the boundaries are where the clusters compete
+    for (int y = 0; y < images[2].img.rows; y++) {
+        cv::Vec3b* imgRow = images[2].img.ptr<cv::Vec3b>(y);
+
+        for (int x = 0; x < images[2].img.cols; x++) {
+            const int block = (x / 37) * 7 + (y / 29) * 13;
+            imgRow[x] = cv::Vec3b((uchar)((block * 53) % 200 + rng.uniform(0, 24)), (uchar)((block * 97) % 200 + rng.uniform(0, 24)), (uchar)((block * 31) % 200 + rng.uniform(0, 24)));
+        }
+    }
+
+    return images;
+}
+
+std::vector<TestCase> MakeCases() {
+    std::vector<TestCase> cases;
+
+    for (const slic::DistanceMode mode : { slic::DistanceMode::Float, slic::DistanceMode::Fixed }) {
+        const std::string suffix = mode == slic::DistanceMode::Float ? " (float)" : " (fixed)";
+
+        slic::Params params;
+        params.superpixels = 300;
+        params.compactness = 20;
+        params.distanceMode = mode;
+
+        // the running sums have to follow the labels exactly as a rescan would
+        TestCase update = { "incremental update matches full" + suffix, params, params };
+        update.reference.updateMode = slic::UpdateMode::Full;
+        update.reference.freezeClusters = false;
+        update.variant.updateMode = slic::UpdateMode::Incremental;
+        update.variant.freezeClusters = false;
+        cases.push_back(update);
+
+        // with frozen clusters only the cells a pass could relabel are compared with the last one;
+        // the tolerance lets clusters that still move a little relabel pixels outside the dirty cells
+        TestCase frozenUpdate = { "incremental update matches full with frozen clusters" + suffix, params, params };
+        frozenUpdate.reference.updateMode = slic::UpdateMode::Full;
+        frozenUpdate.variant.updateMode = slic::UpdateMode::Incremental;
+        frozenUpdate.reference.freezeClusters = frozenUpdate.variant.freezeClusters = true;
+        frozenUpdate.reference.freezeTolerance = frozenUpdate.variant.freezeTolerance = 2;
+        cases.push_back(frozenUpdate);
+
+        // with no tolerance, a frozen cluster is one whose pixels could not have changed owner;
+        // the centroid threshold would end the unfrozen run at another pass, so both run a fixed count
+        TestCase freeze = { "frozen clusters match unfrozen" + suffix, params, params };
+        freeze.reference.threshold = freeze.variant.threshold = 0;
+        freeze.reference.maxIterations = freeze.variant.maxIterations = 8;
+        freeze.reference.freezeClusters = false;
+        freeze.variant.freezeClusters = true;
+        freeze.variant.freezeTolerance = 0;
+        cases.push_back(freeze);
+    }
+
+    return cases;
+}
+
+std::vector<slic::Params> KernelParams() {
+    std::vector<slic::Params> kernels;
+
+    for (const slic::DistanceMode mode : { slic::DistanceMode::Float, slic::DistanceMode::Fixed }) {
+        for (const bool lab : { false, true }) {
+            slic::Params params;
+            params.superpixels = 300;
+            params.compactness = 20;
+            params.distanceMode = mode;
+            params.useLab = lab;
+            kernels.push_back(params);
+        }
+    }
+
+    return kernels;
+}
+
+bool SameLabels(const cv::Mat& expected, const cv::Mat& actual) {
+    if (expected.size() != actual.size() || expected.type() != actual.type())
+        return false;
+
+    for (int y = 0; y < expected.rows; y++)
+        if (memcmp(expected.ptr(y), actual.ptr(y), expected.cols * expected.elemSize()) != 0)
+            return false;
+
+    return true;
+}
+
+bool SameCentroids(const std::vector<slic::ColoredPoint>& expected, const std::vector<slic::ColoredPoint>& actual) {
+    if (expected.size() != actual.size())
+        return false;
+
+    // ColoredPoint::operator== only compares the positions
+    for (size_t k = 0; k < expected.size(); k++)
+        if (!(expected[k] == actual[k]) || expected[k].color != actual[k].color)
+            return false;
+
+    return true;
+}
+
+bool WriteLabels(const std::string& path, const std::vector<TestImage>& images) {
+    std::ofstream file(path, std::ios::binary);
+
+    for (const slic::Params& params : KernelParams()) {
+        slic::Segmenter segmenter(params);
+
+        for (const TestImage& image : images) {
+            const cv::Mat& labels = segmenter.Segment(image.img);
+
+            for (int y = 0; y < labels.rows; y++)
+                file.write(labels.ptr<char>(y), (std::streamsize)labels.cols * sizeof(int));
+        }
+    }
+
+    return file.good();
+}
+
+bool CompareLabels(const std::string& path, const std::vector<TestImage>& images) {
+    std::ifstream file(path, std::ios::binary);
+    const std::vector<slic::Params> kernels = KernelParams();
+    int failures = 0;
+
+    if (!file.is_open()) {
+        std::cerr << "Unable to read " << path << std::endl;
+        return false;
+    }
+
+    for (const slic::Params& params : kernels) {
+        slic::Segmenter segmenter(params);
+
+        for (const TestImage& image : images) {
+            const cv::Mat& labels = segmenter.Segment(image.img);
+            cv::Mat expected(labels.size(), CV_32SC1);
+
+            file.read(expected.ptr<char>(), (std::streamsize)expected.total() * sizeof(int));
+
+            const bool same = file.good() && SameLabels(expected, labels);
+
+            std::cout << (same ? "ok   " : "FAIL ") << (params.distanceMode == slic::DistanceMode::Float ? "float" : "fixed")
+                << (params.useLab ? " Lab" : " BGR") << " kernel matches the stored labels on " << image.name << std::endl;
+            failures += same ? 0 : 1;
+        }
+    }
+
+    return failures == 0;
+}
+
+bool CheckMappedFiles() {
+    struct HeaderCase {
+        std::string name, header;
+        bool valid;
+    };
+
+    // a negative size must not wrap the bounds check of the mapping around to a few bytes
+    const std::vector<HeaderCase> headers = {
+        { "PPM header", "P6\n# comment\n4 3\n255\n", true },
+        { "PAM header", "P7\nWIDTH 4\nHEIGHT 3\nDEPTH 3\nMAXVAL 255\nTUPLTYPE RGB\nENDHDR\n", true },
+        { "PPM header with a negative width", "P6\n-4 3\n255\n", false },
+        { "PAM header with a negative size", "P7\nWIDTH -1\nHEIGHT -1\nDEPTH 3\nMAXVAL 255\nTUPLTYPE RGB\nENDHDR\n", false },
+        { "PAM header without a height", "P7\nWIDTH 4\nDEPTH 3\nMAXVAL 255\nTUPLTYPE RGB\nENDHDR\n", false }
+    };
+
+    int failures = 0;
+
+    for (const HeaderCase& test : headers) {
+        const std::string path = test.header[1] == '6' ? "slic_tests_header.ppm" : "slic_tests_header.pam";
+        cv::Size size;
+
+        const bool opened = OpensHeader(path, test.header, size);
+        const bool same = opened == test.valid && (!opened || size == cv::Size(4, 3));
+
+        std::cout << (same ? "ok   " : "FAIL ") << test.name << (test.valid ? " is read" : " is refused") << std::endl;
+        failures += same ? 0 : 1;
+        std::remove(path.c_str());
+    }
+
+    // unlabeled pixels become 65535, and a label uint16 cannot tell apart from them is refused
+    {
+        slic::MappedLabels labels;
+        int tileLabels[] = { -1, 0, 1, 65534, 7, -1 };
+        ushort expectedLabels[] = { 65535, 0, 1, 65534, 7, 65535 };
+        cv::Mat tile(2, 3, CV_32SC1, tileLabels), expected(2, 3, CV_16UC1, expectedLabels);
+
+        bool same = labels.Create("slic_tests_labels.raw", tile.size(), CV_16U) && labels.Write(tile) && SameLabels(expected, labels.Labels());
+        std::cout << (same ? "ok   " : "FAIL ") << "uint16 labels mark unlabeled pixels as 65535" << std::endl;
+        failures += same ? 0 : 1;
+
+        tile.at<int>(1, 1) = 65535;
+        same = !labels.Write(tile);
+        std::cout << (same ? "ok   " : "FAIL ") << "uint16 labels refuse label 65535" << std::endl;
+        failures += same ? 0 : 1;
+    }
+
+    std::remove("slic_tests_labels.raw");
+    return failures == 0;
+}
+
+bool OpensHeader(const std::string& path, const std::string& header, cv::Size& size) {
+    {
+        std::ofstream file(path, std::ios::binary);
+        file << header << std::string(4 * 3 * 3, '\x80');
+    }
+
+    slic::MappedImage image;
+
+    if (!image.Open(path))
+        return false;
+
+    size = image.Size();
+    return true;
+}
\ No newline at end of file
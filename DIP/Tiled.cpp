@@ -0,0 +1,164 @@
+#include "stdafx.h"
+
+#include "Tiled.h"
+
+namespace slic {
+
+bool MatTileReader::Read(const cv::Rect& rect, ImageView& region) {
+    region = ImageView(img).Region(rect);
+    return true;
+}
+
+MatTileWriter::MatTileWriter(cv::Mat& labels, const cv::Size& size)
+    : labels(labels) {
+    labels.create(size, CV_32SC1);
+}
+
+bool MatTileWriter::Write(const cv::Rect& rect, const cv::Mat& tile) {
+    cv::Mat target = labels(rect);
+    tile.copyTo(target);
+    return true;
+}
+
+RawTileReader::RawTileReader(const std::string& path, const cv::Size& size, const std::streamoff& offset)
+    : file(path, std::ios::binary), size(size), offset(offset) {}
+
+bool RawTileReader::Read(const cv::Rect& rect, ImageView& region) {
+    buffer.create(rect.size(), CV_8UC3);
+
+    for (int y = 0; y < rect.height; y++) {
+        file.seekg(offset + ((std::streamoff)(rect.y + y) * size.width + rect.x) * 3);
+        file.read(buffer.ptr<char>(y), (std::streamsize)rect.width * 3);
+    }
+
+    region = ImageView(buffer);
+    return file.good();
+}
+
+RawTileWriter::RawTileWriter(const std::string& path, const cv::Size& size)
+    : file(path, std::ios::binary | std::ios::in | std::ios::out | std::ios::trunc), size(size) {
+
+    // the file gets its final length up front, tiles then only overwrite their rows
+    if (file.is_open() && size.area() > 0) {
+        file.seekp((std::streamoff)size.width * size.height * sizeof(int) - 1);
+        file.put(0);
+    }
+}
+
+bool RawTileWriter::Write(const cv::Rect& rect, const cv::Mat& labels) {
+
+    for (int y = 0; y < rect.height; y++) {
+        file.seekp(((std::streamoff)(rect.y + y) * size.width + rect.x) * sizeof(int));
+        file.write(labels.ptr<char>(y), (std::streamsize)rect.width * sizeof(int));
+    }
+
+    return file.good();
+}
+
+TiledSegmenter::TiledSegmenter(const Params& params, const int& tileSize)
+    : segmenter(params), tileSize(tileSize), tiles(0) {}
+
+bool TiledSegmenter::Segment(TileReader& reader, TileWriter& writer) {
+    const Params& params = segmenter.GetParams();
+    const cv::Size size = reader.Size();
+    const cv::Rect image(cv::Point(), size);
+
+    const int S = GridInterval(size, params.superpixels); // the grid of Segmenter::Segment()
+    const int halo = 4 * S; // 2S to the farthest centroid that can claim a core pixel, 2S more for its window
+    const int start = S / 2;
+
+    // a halo wider than half the tile would make every region several tiles large, up to the whole image
+    CV_Assert(S > 0 && tileSize > 0 && 2 * halo <= tileSize);
+
+    const int gridCols = (size.width - start + S - 1) / S;
+    const int gridRows = (size.height - start + S - 1) / S;
+
+    // the same grid the in-memory segmentation would seed, colored once a tile reaches it
+    centroids.resize((size_t)gridCols * gridRows);
+    states.assign(centroids.size(), ClusterState::Unseeded);
+
+    for (int j = 0; j < gridRows; j++)
+        for (int i = 0; i < gridCols; i++)
+            centroids[(size_t)j * gridCols + i] = ColoredPoint(cv::Vec3b(0, 0, 0), start + i * S, start + j * S);
+
+    tiles = 0;
+
+    for (int ty = 0; ty < size.height; ty += tileSize) {
+        for (int tx = 0; tx < size.width; tx += tileSize) {
+            const cv::Rect core = cv::Rect(tx, ty, tileSize, tileSize) & image;
+            const cv::Rect bounds = cv::Rect(core.x - halo, core.y - halo, core.width + 2 * halo, core.height + 2 * halo) & image;
+
+            if (!reader.Read(bounds, region))
+                return false;
+
+            // grid cells one beyond the region still catch centroids that drifted into it
+            const int fromI = std::max((bounds.x - start) / S - 1, 0);
+            const int toI = std::min((bounds.br().x - start) / S + 1, gridCols - 1);
+            const int fromJ = std::max((bounds.y - start) / S - 1, 0);
+            const int toJ = std::min((bounds.br().y - start) / S + 1, gridRows - 1);
+
+            seeds.clear();
+            seedStates.clear();
+            seedClusters.clear();
+
+            for (int j = fromJ; j <= toJ; j++) {
+                for (int i = fromI; i <= toI; i++) {
+                    const int k = j * gridCols + i;
+                    const ColoredPoint& centroid = centroids[k];
+
+                    if (!bounds.contains(cv::Point(centroid.x, centroid.y)))
+                        continue;
+
+                    seeds.emplace_back(centroid.color, centroid.x - bounds.x, centroid.y - bounds.y);
+                    seedStates.push_back(states[k] == ClusterState::Settled ? SeedState::Fixed : states[k] == ClusterState::Estimated ? SeedState::Free : SeedState::Unseeded);
+                    seedClusters.push_back(k);
+                }
+            }
+
+            const cv::Mat& labels = segmenter.Segment(region, S, seeds, seedStates);
+
+            // the tile settles the clusters seeded in its core, the others stay estimates unless they own
+            // a pixel of the core below
+            for (size_t n = 0; n < seeds.size(); n++) {
+                const int k = seedClusters[n];
+
+                if (states[k] == ClusterState::Settled)
+                    continue;
+
+                const cv::Point cell(start + (k % gridCols) * S, start + (k / gridCols) * S);
+
+                centroids[k] = ColoredPoint(seeds[n].color, seeds[n].x + bounds.x, seeds[n].y + bounds.y);
+                states[k] = core.contains(cell) ? ClusterState::Settled : ClusterState::Estimated;
+            }
+
+            // only the core is written, the halo belongs to the neighbouring tiles; a cluster that
+            // owns a written pixel is settled too, so the later tiles label their side of the seam
+            // with the centroid this one used
+            tileLabels.create(core.size(), CV_32SC1);
+
+            for (int y = 0; y < core.height; y++) {
+                const int* labelRow = labels.ptr<int>(y + core.y - bounds.y) + (core.x - bounds.x);
+                int* tileRow = tileLabels.ptr<int>(y);
+
+                for (int x = 0; x < core.width; x++) {
+                    if (labelRow[x] < 0) {
+                        tileRow[x] = -1;
+                        continue;
+                    }
+
+                    tileRow[x] = seedClusters[labelRow[x]];
+                    states[tileRow[x]] = ClusterState::Settled;
+                }
+            }
+
+            if (!writer.Write(core, tileLabels))
+                return false;
+
+            tiles++;
+        }
+    }
+
+    return true;
+}
+
+}
\ No newline at end of file
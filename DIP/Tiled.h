@@ -0,0 +1,116 @@
+#pragma once
+
+#include <fstream>
+
+#include "Segmenter.h"
+
+namespace slic {
+
+// Source of an image too large to hold in memory, read one rectangle at a time.
+class TileReader {
+public:
+    virtual ~TileReader() {}
+
+    virtual cv::Size Size() const = 0;
+
+    // Points 'region' at the pixels of 'rect', valid until the next call. Readers that hold the
+    // image in memory hand out a sub-view, so the conversion reads the tile in place.
+    virtual bool Read(const cv::Rect& rect, ImageView& region) = 0;
+};
+
+// Destination of the label map, written one tile at a time.
+class TileWriter {
+public:
+    virtual ~TileWriter() {}
+
+    // Stores the CV_32SC1 labels of 'rect'.
+    virtual bool Write(const cv::Rect& rect, const cv::Mat& labels) = 0;
+};
+
+// Serves tiles from an image that is already in memory.
+class MatTileReader : public TileReader {
+public:
+    explicit MatTileReader(const cv::Mat& img) : img(img) {}
+
+    cv::Size Size() const override { return img.size(); }
+    bool Read(const cv::Rect& rect, ImageView& region) override;
+
+private:
+    const cv::Mat img;
+};
+
+// Collects the tiles into a label map in memory.
+class MatTileWriter : public TileWriter {
+public:
+    MatTileWriter(cv::Mat& labels, const cv::Size& size);
+
+    bool Write(const cv::Rect& rect, const cv::Mat& tile) override;
+
+private:
+    cv::Mat& labels;
+};
+
+// Streams tiles from a headerless file of interleaved 8-bit BGR rows, one row at a time.
+class RawTileReader : public TileReader {
+public:
+    RawTileReader(const std::string& path, const cv::Size& size, const std::streamoff& offset = 0);
+
+    bool IsOpen() const { return file.is_open(); }
+    cv::Size Size() const override { return size; }
+    bool Read(const cv::Rect& rect, ImageView& region) override;
+
+private:
+    std::ifstream file;
+    const cv::Size size;
+    const std::streamoff offset; // bytes before the first row, e.g. a header
+    cv::Mat buffer; // rows of the last tile, the file cannot be read in place
+};
+
+// Writes the labels as headerless little-endian int32 rows, seeking to every row of a tile.
+class RawTileWriter : public TileWriter {
+public:
+    RawTileWriter(const std::string& path, const cv::Size& size);
+
+    bool IsOpen() const { return file.is_open(); }
+    bool Write(const cv::Rect& rect, const cv::Mat& labels) override;
+
+private:
+    std::fstream file;
+    const cv::Size size;
+};
+
+// Segments an image tile by tile. Every tile is read with a halo of 4S: any cluster that can
+// claim a core pixel lies within 2S of it and sees its whole 2S window. The clusters are the
+// seeds of one global grid.
+// A cluster is settled by the tile its seed falls in, or by the first tile that writes one of
+// its pixels, and later tiles keep it fixed, so both sides of a seam use the same centroids. Memory is bounded by the tile size plus the
+// per-cluster table, whatever the image size, as long as the halo is at most half a tile;
+// Segment() throws for a grid interval S above tileSize / 8.
+class TiledSegmenter {
+public:
+    explicit TiledSegmenter(const Params& params = Params(), const int& tileSize = 2048);
+
+    bool Segment(TileReader& reader, TileWriter& writer);
+
+    // Centroids in image coordinates and the working color space; the written labels index them.
+    const std::vector<ColoredPoint>& Centroids() const { return centroids; }
+    int Tiles() const { return tiles; }
+
+private:
+    enum class ClusterState : uchar { Unseeded, Estimated, Settled };
+
+    Segmenter segmenter;
+    const int tileSize;
+
+    std::vector<ColoredPoint> centroids;
+    std::vector<ClusterState> states;
+    int tiles;
+
+    ImageView region;
+    cv::Mat tileLabels;
+    std::vector<ColoredPoint> seeds;
+    std::vector<SeedState> seedStates;
+    std::vector<int> seedClusters; // global index of every seed of the current tile
+};
+
+}
@@ -0,0 +1,129 @@
+#include "stdafx.h"
+
+#include "Mapped.h"
+
+#include <iostream>
+#include <chrono>
+
+bool ParseSize(const std::string& text, cv::Size& size);
+
+
+int main(int argc, char** argv) {
+    slic::Params params;
+    slic::RawFormat format;
+    int labelDepth = CV_32S;
+    int tileSize = 2048;
+    int superpixels = 0; // 0 for one per 64 x 64 pixels, whatever the image size
+    std::vector<std::string> paths;
+
+    for (int i = 1; i < argc; i++) {
+        const std::string option = argv[i];
+
+        if (option.compare(0, 2, "--") != 0)
+            paths.push_back(option);
+        else if (i + 1 >= argc)
+            paths.clear();
+        else if (option == "--size")
+            ParseSize(argv[++i], format.size);
+        else if (option == "--offset")
+            format.offset = (size_t)atoll(argv[++i]);
+        else if (option == "--labels")
+            labelDepth = std::string(argv[++i]) == "uint16" ? CV_16U : CV_32S;
+        else if (option == "--tile")
+            tileSize = std::max(atoi(argv[++i]), 0);
+        else if (option == "--superpixels")
+            superpixels = std::max(atoi(argv[++i]), 1);
+        else if (option == "--compactness")
+            params.compactness = std::max(atoi(argv[++i]), 1);
+        else {
+            paths.clear();
+            break;
+        }
+    }
+
+    if (paths.size() != 2) {
+        std::cerr << "Usage: slic_tiled [--size WIDTHxHEIGHT] [--offset BYTES] [--tile N] [--labels int32|uint16]\n"
+            << "                  [--superpixels K] [--compactness M] INPUT LABELS.raw\n"
+            << "INPUT is a binary PPM or PAM, or raw 8-bit pixels described by --size or by the sidecar INPUT.hdr.\n"
+            << "LABELS receives headerless rows. --tile 0 segments the whole image in one pass.\n"
+            << "K defaults to one superpixel per 64x64 pixels; the tile has to be at least 8 times the grid interval." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    cv::setNumThreads(cv::getNumberOfCPUs());
+
+    // both files are mapped, so pixels are read and labels written in place as pages fault in
+    slic::MappedImage reader;
+    slic::MappedLabels writer;
+
+    const bool opened = format.size.width > 0 && format.size.height > 0 ? reader.Open(paths[0], format) : reader.Open(paths[0]);
+
+    if (!opened) {
+        printf("Unable to open %s (%s, %d).", paths[0].c_str(), __FILE__, __LINE__);
+        return EXIT_FAILURE;
+    }
+
+    const cv::Size size = reader.Size();
+
+    // the Params default of 15 superpixels would make the halo of a large image span all of it
+    const int64 pixels = (int64)size.width * size.height;
+    params.superpixels = superpixels > 0 ? superpixels : (int)std::min(std::max(pixels / (64 * 64), (int64)1), (int64)INT_MAX);
+
+    // uint16 holds the labels 0 to 65534, 65535 marks pixels without a cluster
+    const int clusterCount = slic::GridSeedCount(size, slic::GridInterval(size, params.superpixels));
+
+    if (labelDepth == CV_16U && clusterCount >= 65535) {
+        std::cerr << "The " << clusterCount << " clusters of " << paths[0] << " do not fit uint16 labels, which hold at most 65534; use --labels int32" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (!writer.Create(paths[1], size, labelDepth)) {
+        printf("Unable to open %s (%s, %d).", paths[1].c_str(), __FILE__, __LINE__);
+        return EXIT_FAILURE;
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    bool succeeded;
+    size_t clusters;
+    int tiles = 1;
+
+    try {
+        if (tileSize > 0) {
+            slic::TiledSegmenter segmenter(params, tileSize);
+
+            succeeded = segmenter.Segment(reader, writer);
+            clusters = segmenter.Centroids().size();
+            tiles = segmenter.Tiles();
+        }
+        else {
+            slic::Segmenter segmenter(params);
+
+            succeeded = writer.Write(segmenter.Segment(reader.View()));
+            clusters = segmenter.Centroids().size();
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Unable to segment " << paths[0] << " with " << params.superpixels << " superpixels in tiles of " << tileSize << ": " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    const double elapsed = std::chrono::duration<double>(end - start).count();
+
+    std::cout << tiles << " tiles, " << clusters << " clusters in " << elapsed << " s: "
+        << (double)size.width * size.height / (elapsed * 1e6) << " MP/s" << std::endl;
+
+    return succeeded ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+bool ParseSize(const std::string& text, cv::Size& size) {
+    const size_t separator = text.find('x');
+
+    if (separator == std::string::npos)
+        return false;
+
+    size = cv::Size(atoi(text.substr(0, separator).c_str()), atoi(text.substr(separator + 1).c_str()));
+    return true;
+}
\ No newline at end of file
@@ -0,0 +1,39 @@
+#include "stdafx.h"
+
+#include "Video.h"
+
+namespace slic {
+
+VideoSegmenter::VideoSegmenter(const Params& params, const int& warmIterations, const int& keyframeInterval)
+    : segmenter(params), params(params), warmIterations(warmIterations), keyframeInterval(keyframeInterval),
+    S(0), frames(0), sinceKeyframe(0), warmStarted(false) {}
+
+const cv::Mat& VideoSegmenter::Segment(const cv::Mat& bgr, Stats* stats) {
+    warmStarted = !previous.empty() && bgr.size() == size && (keyframeInterval <= 0 || sinceKeyframe < keyframeInterval);
+
+    if (warmStarted) {
+        Params warm = params;
+        warm.maxIterations = params.maxIterations > 0 ? std::min(params.maxIterations, warmIterations) : warmIterations;
+
+        // every centroid moves freely from where the last frame left it
+        states.assign(previous.size(), SeedState::Free);
+
+        segmenter.SetParams(warm);
+        segmenter.Segment(bgr, S, previous, states, stats);
+        sinceKeyframe++;
+    }
+    else {
+        segmenter.SetParams(params);
+        segmenter.Segment(bgr, stats);
+
+        previous = segmenter.Centroids();
+        size = bgr.size();
+        S = GridInterval(bgr.size(), params.superpixels);
+        sinceKeyframe = 1;
+    }
+
+    frames++;
+    return segmenter.Labels();
+}
+
+}
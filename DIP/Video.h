@@ -0,0 +1,42 @@
+#pragma once
+
+#include "Segmenter.h"
+
+namespace slic {
+
+// Segments the frames of a video one after another. Every frame starts from the converged
+// centroids of the previous one and runs a capped number of passes, so a frame that barely
+// changed settles in one or two passes instead of converging again from the grid.
+class VideoSegmenter {
+public:
+    // 'warmIterations' caps the passes of a warm-started frame. Every 'keyframeInterval' frames
+    // the seeds come from a fresh grid again, 0 to only do so on the first frame and after Reset().
+    explicit VideoSegmenter(const Params& params = Params(), const int& warmIterations = 2, const int& keyframeInterval = 0);
+
+    const cv::Mat& Segment(const cv::Mat& bgr, Stats* stats = nullptr);
+
+    // Seeds the next frame from the grid, e.g. after a scene cut.
+    void Reset() { previous.clear(); }
+
+    void Colorate(cv::Mat& result) const { segmenter.Colorate(result); }
+
+    const cv::Mat& Labels() const { return segmenter.Labels(); }
+    const std::vector<ColoredPoint>& Centroids() const { return previous; }
+    int Iterations() const { return segmenter.Iterations(); }
+    const StageTimings& Timings() const { return segmenter.Timings(); }
+    int Frames() const { return frames; }
+    bool WarmStarted() const { return warmStarted; } // whether the last frame started from the previous centroids
+
+private:
+    Segmenter segmenter;
+    const Params params;
+    const int warmIterations, keyframeInterval;
+
+    std::vector<ColoredPoint> previous; // converged centroids of the last frame, the next seeds
+    std::vector<SeedState> states;
+    cv::Size size;
+    int S, frames, sinceKeyframe;
+    bool warmStarted;
+};
+
+}
@@ -0,0 +1,358 @@
+#include "stdafx.h"
+
+#include "Video.h"
+
+#include <iostream>
+#include <chrono>
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+#include <opencv2/videoio.hpp>
+
+typedef std::chrono::high_resolution_clock Clock;
+
+struct VideoOptions {
+    std::string input, output;
+    slic::Params params;
+    int warmIterations = 2;
+    int keyframeInterval = 0;
+    int queueCapacity = 4; // frames each queue holds before its producer blocks
+    std::string codec = "MJPG";
+};
+
+// One frame on its way through the pipeline, with the time every stage spent on it.
+struct Frame {
+    int index;
+    cv::Mat bgr, lab, labels;
+    std::vector<slic::ColoredPoint> centroids;
+    Clock::time_point start; // when its decoding began, the reference of the latency
+    double decode, convert, segment, render, latency; // milliseconds
+    size_t depths[3]; // frames waiting in each queue when this one was taken out, itself included
+    int iterations;
+    bool warm;
+};
+
+// FIFO of at most 'capacity' items between two stages. A full queue blocks the producer, so the
+// slowest stage paces the ones before it instead of the whole video piling up in memory.
+template<typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(const size_t& capacity)
+        : capacity(capacity), closed(false), depthSum(0), maxDepth(0), pops(0) {}
+
+    // Blocks while the queue is full; returns false, dropping the item, once it is closed.
+    bool Push(T item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        notFull.wait(lock, [this]() { return items.size() < capacity || closed; });
+
+        if (closed)
+            return false;
+
+        items.push_back(std::move(item));
+        notEmpty.notify_one();
+        return true;
+    }
+
+    // Blocks until an item is available and returns the depth it was taken at, or 0 once the
+    // queue is closed and drained.
+    size_t Pop(T& item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        notEmpty.wait(lock, [this]() { return !items.empty() || closed; });
+
+        const size_t depth = items.size();
+
+        if (depth == 0)
+            return 0;
+
+        item = std::move(items.front());
+        items.pop_front();
+
+        depthSum += depth;
+        maxDepth = std::max(maxDepth, depth);
+        pops++;
+
+        notFull.notify_one();
+        return depth;
+    }
+
+    // Ends the stream; the consumer still receives what is queued, a blocked producer gives up.
+    void Close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        notEmpty.notify_all();
+        notFull.notify_all();
+    }
+
+    double MeanDepth() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return pops ? (double)depthSum / pops : 0;
+    }
+
+    size_t MaxDepth() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return maxDepth;
+    }
+
+private:
+    const size_t capacity;
+    std::deque<T> items;
+    bool closed;
+    size_t depthSum, maxDepth, pops;
+
+    mutable std::mutex mutex;
+    std::condition_variable notEmpty, notFull;
+};
+
+bool ParseOptions(int argc, char** argv, VideoOptions& options);
+
+bool OpenCapture(const std::string& input, cv::VideoCapture& capture);
+
+void ReportFrame(const Frame& frame);
+
+double Percentile(std::vector<double> values, const double& fraction);
+
+double MillisecondsSince(const Clock::time_point& start);
+
+
+int main(int argc, char** argv) {
+    VideoOptions options;
+
+    if (!ParseOptions(argc, argv, options) || options.input.empty()) {
+        std::cerr << "Usage: slic_video [--superpixels K] [--compactness M | --slico] [--warm-iterations N] [--keyframe N]\n"
+            << "                  [--queue N] [--codec FOURCC] INPUT|CAMERA [OUTPUT]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    cv::VideoCapture capture;
+
+    if (!OpenCapture(options.input, capture)) {
+        std::cerr << "Unable to open " << options.input << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    const double fps = capture.get(cv::CAP_PROP_FPS) > 0 ? capture.get(cv::CAP_PROP_FPS) : 30;
+
+    // the stages after the decoder each own one queue, filled by the stage before them
+    BoundedQueue<Frame> decoded(options.queueCapacity), converted(options.queueCapacity), segmented(options.queueCapacity);
+    BoundedQueue<Frame>* queues[] = { &decoded, &converted, &segmented };
+
+    auto start = Clock::now();
+
+    std::thread decodeStage([&]() {
+        for (int index = 0;; index++) {
+            Frame frame;
+            frame.start = Clock::now();
+
+            if (!capture.read(frame.bgr) || frame.bgr.empty())
+                break;
+
+            frame.index = index;
+            frame.decode = MillisecondsSince(frame.start);
+
+            if (!decoded.Push(std::move(frame)))
+                break;
+        }
+
+        decoded.Close();
+    });
+
+    std::thread convertStage([&]() {
+        Frame frame;
+
+        while (const size_t depth = decoded.Pop(frame)) {
+            const auto stageStart = Clock::now();
+
+            frame.depths[0] = depth;
+            slic::ConvertToLab(slic::ImageView(frame.bgr), frame.lab);
+
+            frame.convert = MillisecondsSince(stageStart);
+
+            if (!converted.Push(std::move(frame)))
+                break;
+        }
+
+        converted.Close();
+    });
+
+    std::thread segmentStage([&]() {
+        // the frames arrive in CIELAB already
+        slic::Params params = options.params;
+        params.useLab = false;
+
+        slic::VideoSegmenter segmenter(params, options.warmIterations, options.keyframeInterval);
+        Frame frame;
+
+        while (const size_t depth = converted.Pop(frame)) {
+            const auto stageStart = Clock::now();
+
+            frame.depths[1] = depth;
+
+            // the segmenter reuses its buffers on the next frame, the render stage gets copies
+            frame.labels = segmenter.Segment(frame.lab).clone();
+            frame.centroids = segmenter.Centroids();
+            frame.iterations = segmenter.Iterations();
+            frame.warm = segmenter.WarmStarted();
+            frame.lab.release();
+
+            frame.segment = MillisecondsSince(stageStart);
+
+            if (!segmented.Push(std::move(frame)))
+                break;
+        }
+
+        segmented.Close();
+    });
+
+    // render and encode on this thread, the last stage
+    cv::VideoWriter writer;
+    std::vector<double> latencies;
+    double stageSums[4] = {};
+    bool writable = true;
+    Frame frame;
+
+    std::cout << "frame,decode_ms,convert_ms,segment_ms,render_ms,latency_ms,iterations,warm,convert_queue,segment_queue,render_queue" << std::endl;
+
+    while (const size_t depth = segmented.Pop(frame)) {
+        const auto stageStart = Clock::now();
+
+        frame.depths[2] = depth;
+
+        if (!options.output.empty()) {
+
+            // opened once, with the size of the first frame; without it the other stages are stopped
+            if (!writer.isOpened()) {
+                const std::string& codec = options.codec;
+                writable = writer.open(options.output, cv::VideoWriter::fourcc(codec[0], codec[1], codec[2], codec[3]), fps, frame.bgr.size());
+            }
+
+            if (!writable) {
+                for (BoundedQueue<Frame>* queue : queues)
+                    queue->Close();
+                break;
+            }
+
+            slic::ColorateClusters(frame.centroids, frame.labels, frame.bgr, true);
+            writer.write(frame.bgr);
+        }
+
+        frame.render = MillisecondsSince(stageStart);
+        frame.latency = MillisecondsSince(frame.start);
+
+        stageSums[0] += frame.decode;
+        stageSums[1] += frame.convert;
+        stageSums[2] += frame.segment;
+        stageSums[3] += frame.render;
+        latencies.push_back(frame.latency);
+
+        ReportFrame(frame);
+    }
+
+    decodeStage.join();
+    convertStage.join();
+    segmentStage.join();
+
+    if (!writable) {
+        std::cerr << "Unable to write " << options.output << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    const double elapsed = MillisecondsSince(start) / 1000;
+    const size_t frames = latencies.size();
+
+    if (frames == 0) {
+        std::cerr << "No frames decoded from " << options.input << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    const char* stages[] = { "decode", "convert", "segment", "render" };
+    const int slowest = (int)(std::max_element(stageSums, stageSums + 4) - stageSums);
+
+    // the throughput is bounded by the slowest stage, the queue depths show where frames wait
+    std::cerr << frames << " frames in " << elapsed << " s: " << frames / elapsed << " fps, bounded by " << stages[slowest]
+        << " at " << 1000 * frames / stageSums[slowest] << " fps" << std::endl;
+
+    for (int s = 0; s < 4; s++)
+        std::cerr << "  " << stages[s] << ": " << stageSums[s] / frames << " ms/frame" << std::endl;
+
+    for (int q = 0; q < 3; q++)
+        std::cerr << "  " << stages[q + 1] << " queue: mean depth " << queues[q]->MeanDepth() << ", max " << queues[q]->MaxDepth()
+            << " of " << options.queueCapacity << std::endl;
+
+    std::cerr << "  latency: median " << Percentile(latencies, 0.5) << " ms, p95 " << Percentile(latencies, 0.95)
+        << " ms, max " << Percentile(latencies, 1) << " ms" << std::endl;
+
+    return EXIT_SUCCESS;
+}
+
+
+bool ParseOptions(int argc, char** argv, VideoOptions& options) {
+    std::vector<std::string> paths;
+
+    for (int i = 1; i < argc; i++) {
+        const std::string option = argv[i];
+
+        if (option.compare(0, 2, "--") != 0) {
+            paths.push_back(option);
+            continue;
+        }
+
+        if (option == "--slico") {
+            options.params.adaptiveCompactness = true;
+            continue;
+        }
+
+        if (i + 1 >= argc)
+            return false;
+
+        const std::string value = argv[++i];
+
+        if (option == "--superpixels")
+            options.params.superpixels = std::max(atoi(value.c_str()), 1);
+        else if (option == "--compactness")
+            options.params.compactness = std::max(atoi(value.c_str()), 1);
+        else if (option == "--warm-iterations")
+            options.warmIterations = std::max(atoi(value.c_str()), 1);
+        else if (option == "--keyframe")
+            options.keyframeInterval = std::max(atoi(value.c_str()), 0);
+        else if (option == "--queue")
+            options.queueCapacity = std::max(atoi(value.c_str()), 1);
+        else if (option == "--codec" && value.size() == 4)
+            options.codec = value;
+        else
+            return false;
+    }
+
+    if (paths.empty() || paths.size() > 2)
+        return false;
+
+    options.input = paths[0];
+    options.output = paths.size() > 1 ? paths[1] : "";
+    return true;
+}
+
+bool OpenCapture(const std::string& input, cv::VideoCapture& capture) {
+
+    // a bare number selects a camera
+    if (std::all_of(input.begin(), input.end(), ::isdigit))
+        return capture.open(atoi(input.c_str()));
+
+    return capture.open(input);
+}
+
+void ReportFrame(const Frame& frame) {
+    std::cout << frame.index << "," << frame.decode << "," << frame.convert << "," << frame.segment << "," << frame.render << ","
+        << frame.latency << "," << frame.iterations << "," << (frame.warm ? 1 : 0) << ","
+        << frame.depths[0] << "," << frame.depths[1] << "," << frame.depths[2] << std::endl;
+}
+
+double Percentile(std::vector<double> values, const double& fraction) {
+    std::sort(values.begin(), values.end());
+    return values[std::min((size_t)(fraction * values.size()), values.size() - 1)];
+}
+
+double MillisecondsSince(const Clock::time_point& start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
\ No newline at end of file